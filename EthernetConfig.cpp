@@ -49,5 +49,6 @@ void ethernetSetup() {
   lcdLog.print("Ethernet: ");
   Ethernet.begin(mac, localIp, dnsIp, gwIp, netMask);
   ethernetPresent = w5500.readVersion() == 4;
+  randomSeed((uint32_t)localIp ^ micros()); // controllers on the same network jitter their retries differently
   lcdLog.println(ethernetPresent ? "OK" : "NOT FOUND");
 }
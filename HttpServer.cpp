@@ -18,12 +18,13 @@ void httpServerSetup() {
   ethernetServer.begin();
 }
 
-void httpResponse(int code, char* msg) {
+void httpResponse(int code, char* msg, char* type = "text/html") {
   httpConn.print("HTTP/1.1 ");
   httpConn.print(code);
   httpConn.print(" ");
   httpConn.println(msg);
-  httpConn.println("Content-Type: text/html");
+  httpConn.print("Content-Type: ");
+  httpConn.println(type);
   httpConn.println("Connnection: close");
   httpConn.println();
 }
@@ -43,12 +44,13 @@ struct Route {
   Route* next;
   char* req;
   void (*func)();
+  char* type;
   bool handle(char* path);
 };
 
 bool Route::handle(char* path) {
   if (strcmp(req, path) == 0) {
-    httpResponse(200, "OK");
+    httpResponse(200, "OK", type);
     (*func)();
     httpConnDone();
     return true;
@@ -58,8 +60,8 @@ bool Route::handle(char* path) {
 
 Route* last_route = nullptr;
 
-void httpServerRoute(char *req, void (*func)()) {
-  Route* route = new Route{last_route, req, func};
+void httpServerRoute(char *req, void (*func)(), char* type) {
+  Route* route = new Route{last_route, req, func, type};
   last_route = route;
 }
 
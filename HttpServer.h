@@ -5,11 +5,13 @@
 #include <Ethernet2.h>
 #include <EthernetClient.h>
 
+const uint8_t HTTP_SERVER_SOCKETS = 2; // listening socket & connection being served
+
 extern int httpPort;
 extern EthernetClient httpConn;
 
 void httpServerSetup();
-void httpServerRoute(char *req, void (*func)());
+void httpServerRoute(char *req, void (*func)(), char* type = "text/html"); // type -- Content-Type of response
 void httpServerCheck();
 void httpConnDone();
 
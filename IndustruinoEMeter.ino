@@ -10,7 +10,10 @@
 #include "EthernetConfig.h"
 #include "HttpServer.h"
 #include "Mercury.h"
+#include "aggregate.h"
+#include "crc.h"
 #include "push.h"
+#include "tags.h"
 
 //------- Button ------
 
@@ -22,10 +25,13 @@ Button downButton(23);
 
 const unsigned long STATUS_BLINK_INTERVAL = 1000; // 1 sec
 const unsigned long DISPLAY_RESET_TIMEOUT = 30000; // 30 sec
+const unsigned long LCD_UPDATE_INTERVAL = 250; // max rate of LCD updates on new meter values
 
 Timeout statusTimeout(0);
 bool statusBlink;
 Timeout displayResetTimeout;
+Timeout lcdUpdateTimeout(0);
+bool lcdUpdatePending;
 
 enum { D_TOTAL, D_CUR_DAY, D_PREV_DAY, D_CUR_MONTH, D_PREV_MONTH, D_PR_2_MONTH, D_CUR_YEAR, D_PREV_YEAR, D_TIME, D_MAX };
 
@@ -47,10 +53,11 @@ int displayMode = D_TOTAL;
 
 //------- LCD ------
 
-void printSummary(Print& out) {
+void printSummary(Print& out, Meter& meter) {
   //              01234567890123456789
   char buf[21] = "[?]  ??.?Hz   ?????W";
-  int8_t missingValues = expectedValues - validValues;
+  int8_t validValues = meter.validValues;
+  int8_t missingValues = meter.expectedValues - validValues;
   char status;
   if (statusBlink)
     status = ' ';
@@ -65,34 +72,35 @@ void printSummary(Print& out) {
   else
     status = '!';
   buf[1] = status;
-  hertz.format(buf + 5, 4, FMT_RIGHT | 1);
-  watts[0].format(buf + 14, 5, FMT_RIGHT | 0);
+  meter.hertz.format(buf + 5, 4, FMT_RIGHT | 1);
+  meter.watts[0].format(buf + 14, 5, FMT_RIGHT | 0);
   out.println(buf);
 }
 
-void printPhase(Print& out, uint8_t i) {
+void printPhase(Print& out, Meter& meter, uint8_t i) {
   //              01234567890123456789
   char buf[21] = "I: ???V ??.?A ?????W";
   buf[0] = '0' + i;
-  volts[i].format(buf + 3, 3, FMT_RIGHT | 0);
-  amps[i].format(buf + 8, 4, FMT_RIGHT | 1);
-  watts[i].format(buf + 14, 5, FMT_RIGHT | 0);
+  meter.volts[i].format(buf + 3, 3, FMT_RIGHT | 0);
+  meter.amps[i].format(buf + 8, 4, FMT_RIGHT | 1);
+  meter.watts[i].format(buf + 14, 5, FMT_RIGHT | 0);
   out.println(buf);
 }
 
-void printHeader(Print& out) {
+void printHeader(Print& out, uint8_t m) {
   //              01234567890123456789
   char buf[21] = " --               --";
   char* name = displayNames[displayMode];
   strncpy(&buf[4], name, strlen(name));
+  if (METERS > 1) formatDecimal(m + 1, buf + 18, 2, FMT_RIGHT);
   out.println(buf);
 }
 
-void printEnergy(Print& out, uint8_t i) {
+void printEnergy(Print& out, Meter& meter, uint8_t i) {
   //              012345678901234567890
   char buf[22] = "T ????????.??kWh     ";
   if (i > 0) buf[0] = '0' + i;
-  displayEnergy[i].format(buf + 2, 11, FMT_RIGHT | 2);
+  meter.energy[displayEnergyType][i].format(buf + 2, 11, FMT_RIGHT | 2);
   out.println(buf);
 }
 
@@ -116,19 +124,19 @@ bool checkUp() {
   return upd;
 }
 
-void printTime(Print& out) {
+void printTime(Print& out, Meter& meter) {
   //              01234567890123456789
   char buf[21] = "  ??-??-?? ??:??:?? ";
   char upd[21] = " rescan: ???ms / ?? ";
   char upt[21] = " up: ????d ??:??:?? ";
-  formatDecimal(mercuryTime.year, buf + 2, 2, FMT_ZERO);
-  formatDecimal(mercuryTime.month, buf + 5, 2, FMT_ZERO);
-  formatDecimal(mercuryTime.date, buf + 8, 2, FMT_ZERO);
-  formatDecimal(mercuryTime.hour, buf + 11, 2, FMT_ZERO);
-  formatDecimal(mercuryTime.minute, buf + 14, 2, FMT_ZERO);
-  formatDecimal(mercuryTime.second, buf + 17, 2, FMT_ZERO);
-  formatDecimal(mercuryUpdateTime, upd + 9, 3, FMT_RIGHT);
-  formatDecimal(validValues, upd + 17, 2, FMT_RIGHT);
+  formatDecimal(meter.time.year, buf + 2, 2, FMT_ZERO);
+  formatDecimal(meter.time.month, buf + 5, 2, FMT_ZERO);
+  formatDecimal(meter.time.date, buf + 8, 2, FMT_ZERO);
+  formatDecimal(meter.time.hour, buf + 11, 2, FMT_ZERO);
+  formatDecimal(meter.time.minute, buf + 14, 2, FMT_ZERO);
+  formatDecimal(meter.time.second, buf + 17, 2, FMT_ZERO);
+  formatDecimal(meter.updateTime, upd + 9, 3, FMT_RIGHT);
+  formatDecimal(meter.validValues, upd + 17, 2, FMT_RIGHT);
   // prepare uptime
   formatDecimal(updays, upt + 5, 4, FMT_RIGHT);
   int32_t time = (millis() - daystart) / 1000; // convert seconds
@@ -143,24 +151,25 @@ void printTime(Print& out) {
   out.println(upt);
 }
 
-void printStatus(Print& out) {
-  printSummary(out);
+void printStatus(Print& out, uint8_t m) {
+  Meter& meter = meters[m];
+  printSummary(out, meter);
   for (uint8_t i = 1; i <= 3; i++)
-    printPhase(out, i);
-  printHeader(out);
+    printPhase(out, meter, i);
+  printHeader(out, m);
   switch(displayMode) {
     case D_TIME:
-      printTime(out);
+      printTime(out, meter);
       break;
     default:
       for (uint8_t i = 0; i <= TARIFFS; i++)
-        printEnergy(out, i);
+        printEnergy(out, meter, i);
   }
 }
 
 void updateLCD(bool logStatus) {
   lcdLog.reset(logStatus);
-  printStatus(lcdLog);
+  printStatus(lcdLog, displayMeter);
 }
 
 bool checkStatusBlink() {
@@ -182,6 +191,11 @@ bool checkButtons() {
     if (displayMode == D_MAX) displayMode = 0;
     upd = true;
   }
+  if (METERS > 1 && enterButton.check() && enterButton.pressed()) {
+    displayMeter++;
+    if (displayMeter == METERS) displayMeter = 0;
+    upd = true;
+  }
   if (upd) displayResetTimeout.reset(DISPLAY_RESET_TIMEOUT);
   if (displayResetTimeout.check()) {
     if (displayMode != 0) upd = true;
@@ -197,11 +211,28 @@ bool checkButtons() {
 
 void httpRoot() {
   httpConn.print("<pre>");
-  printStatus(httpConn);
-  printTime(httpConn);
+  for (uint8_t m = 0; m < METERS; m++) {
+    if (m > 0) httpConn.println();
+    printStatus(httpConn, m);
+    printTime(httpConn, meters[m]);
+  }
   httpConn.println("</pre>");
 }
 
+void httpStats() {
+  printMercuryStats(httpConn);
+}
+
+void httpAggregates() {
+  printAggregates(httpConn);
+}
+
+#ifdef CRC_BENCHMARK
+void httpCRC() {
+  benchCRC(httpConn);
+}
+#endif
+
 void httpReset() {
   httpConn.println("Rebooting");
   httpConnDone();
@@ -211,53 +242,224 @@ void httpReset() {
 
 //------- PUSH DATA -------
 
-PushItem* hertzTag;
-PushItem* wattsTag[4];
-PushItem* voltsTag[4];
-PushItem* ampsTag[4];
-PushItem* curDayEnergyTag[TARIFFS + 1];
-PushItem* prevDayEnergyTag[TARIFFS + 1];
-
-PushItem* setupTag(char* prefix, int i, char* suffix) {
-  auto pl = strlen(prefix);
-  auto sl = strlen(suffix);
-  int il = i > 0 ? 1 : 0;
-  char* c = new char[pl + il + sl + 1];
-  strncpy(c, prefix, pl);
-  if (i > 0) c[pl] = '0' + i;
-  strncpy(c + pl + il, suffix, sl);
-  c[pl + il + sl] = 0;
-  return pushTag(c);
+// power samples that are uploaded in batches
+const unsigned long SAMPLE_INTERVAL = 2500; // 2.5 sec
+const uint8_t SAMPLE_COUNT = 160; // 6m40s, a bit more than push interval
+const int32_t SAMPLE_QUANTUM = 10; // 1 W
+
+unsigned long sampleInterval = SAMPLE_INTERVAL; // changed remotely
+
+PushSeries wattsSeries[METERS][4];
+int16_t wattsDeltas[METERS][4][SAMPLE_COUNT];
+
+// tag t0 of total or tag t1 of phase 1 in phase i
+PushId meterPhaseTag(uint8_t m, uint8_t i, int t0, int t1) {
+  return i == 0 ? meterTag(m, t0) : phaseTag(m, i, t1);
 }
 
 void setupPushTags() {
-  hertzTag = pushTag("Ef");
-  for (int i = 0; i <= 3; i++) {
-    wattsTag[i] = setupTag("E", i, "");
-    if (i > 0) {
-      voltsTag[i] = setupTag("E", i, "v");
-      ampsTag[i] = setupTag("E", i, "a");
+  setupPush();
+  for (uint8_t m = 0; m < METERS; m++)
+    for (uint8_t i = 0; i <= 3; i++)
+      pushSeries(meterPhaseTag(m, i, T_WATTS_SAMPLES_0, T_WATTS_SAMPLES_1), wattsSeries[m][i],
+        wattsDeltas[m][i], SAMPLE_QUANTUM, sampleInterval, SAMPLE_COUNT);
+}
+
+void pushAgg(PushId id, AggValue& value) {
+  Aggregate& a = value.last;
+  if (a.n == 0) return;
+  push(id + AGG_MEAN, a.meanValue(), 1);
+  push(id + AGG_MIN, a.min, 1);
+  push(id + AGG_MAX, a.max, 1);
+  push(id + AGG_DEV, a.stdDev(), 1);
+}
+
+// pushes aggregates over the last complete window instead of point samples
+void pushAggregates() {
+  for (uint8_t m = 0; m < METERS; m++) {
+    MeterAgg& agg = meterAggs[m];
+    pushAgg(meterTag(m, T_HERTZ), agg.hertz);
+    pushAgg(meterTag(m, T_IMBALANCE), agg.imbalance);
+    for (uint8_t i = 0; i <= 3; i++) {
+      pushAgg(meterPhaseTag(m, i, T_WATTS_0, T_WATTS_1), agg.watts[i]);
+      if (i > 0) {
+        pushAgg(phaseTag(m, i, T_VOLTS_1), agg.volts[i]);
+        pushAgg(phaseTag(m, i, T_AMPS_1), agg.amps[i]);
+        pushAgg(phaseTag(m, i, T_APPARENT_1), agg.apparent[i]);
+      }
     }
   }
-  for (int i = 0; i <= TARIFFS; i++) {
-    curDayEnergyTag[i] = setupTag("E", i, "c");
-    prevDayEnergyTag[i] = setupTag("E", i, "p");
-  }
 }
 
 void pushData() {
-  push(hertzTag, hertz);
-  for (int i = 0; i <= 3; i++) {
-    push(wattsTag[i], watts[i]);
-    if (i > 0) {
-      push(voltsTag[i], volts[i]);
-      push(ampsTag[i], amps[i]);
+  for (uint8_t m = 0; m < METERS; m++) {
+    Meter& meter = meters[m];
+    for (uint8_t i = 0; i <= 3; i++)
+      pushSample(meterPhaseTag(m, i, T_WATTS_SAMPLES_0, T_WATTS_SAMPLES_1), meter.watts[i], meter.watts[i].mantissa() != INVALID_VALUE);
+    for (uint8_t i = 0; i <= TARIFFS; i++) {
+      push(meterTag(m, T_CUR_DAY_0 + i), meter.energy[E_CUR_DAY][i]);
+      push(meterTag(m, T_PREV_DAY_0 + i), meter.energy[E_PREV_DAY][i]);
+    }
+    for (uint8_t i = 0; i < meter.profileCount; i++) {
+      ProfileRecord& rec = meter.profile[i];
+      pushHistory(meterTag(m, T_PROFILE), rec.watts, PushTime{rec.time.year, rec.time.month, rec.time.date, rec.time.hour, rec.time.minute});
     }
+    meter.profileCount = 0;
   }
-  for (int i = 0; i <= TARIFFS; i++) {
-    push(curDayEnergyTag[i], curDayEnergy[i]);
-    push(prevDayEnergyTag[i], prevDayEnergy[i]);
+}
+
+//------- COMMANDS -------
+
+// diagnostic mode: meters are polled faster, every change and 1 sec samples are uploaded every minute
+const uint16_t DIAG_POLL_PERCENT = 20;
+const long DIAG_PUSH_INTERVAL = 60000L; // 1min
+const unsigned long DIAG_SAMPLE_INTERVAL = 1000; // 1 sec
+const long MAX_DIAG_MINUTES = 24 * 60;
+
+const long MIN_PUSH_SEC = 10;
+const long MAX_PUSH_SEC = 3600;
+const long MIN_SAMPLE_INTERVAL = 500; // 0.5 sec
+const long MAX_SAMPLE_INTERVAL = 60000; // 1 min
+const long MIN_AGG_SEC = 10;
+const long MAX_AGG_SEC = 3600;
+
+bool diagMode;
+Timeout diagTimeout; // when diagnostic mode ends
+
+// splits the next space-separated argument, nullptr when there are no more
+char* nextArg(char*& args) {
+  while (*args == ' ')
+    args++;
+  if (*args == 0)
+    return nullptr;
+  char* arg = args;
+  while (*args != 0 && *args != ' ')
+    args++;
+  if (*args != 0)
+    *args++ = 0;
+  return arg;
+}
+
+// tag is the first argument, nullptr when it is not known
+PushItem* tagArg(char*& args) {
+  char* tag = nextArg(args);
+  PushId id = tag == nullptr ? PUSH_TAG_COUNT : findTag(tag);
+  if (id == PUSH_TAG_COUNT) {
+    commandReply.print("unknown tag");
+    return nullptr;
   }
+  commandReply.print(tag);
+  commandReply.print(' ');
+  return &pushItems[id];
+}
+
+void setSampleInterval(unsigned long interval) {
+  sampleInterval = interval;
+  for (uint8_t m = 0; m < METERS; m++)
+    for (uint8_t i = 0; i <= 3; i++)
+      setSeriesInterval(meterPhaseTag(m, i, T_WATTS_SAMPLES_0, T_WATTS_SAMPLES_1), interval);
+}
+
+// default settings are restored when diagnostic mode ends
+void setDiag(long minutes) {
+  diagMode = minutes > 0;
+  if (diagMode) {
+    diagTimeout.reset(minutes * Timeout::MINUTE);
+    pollPercent = DIAG_POLL_PERCENT;
+    setSampleInterval(DIAG_SAMPLE_INTERVAL);
+    for (PushId id = 0; id < PUSH_TAG_COUNT; id++)
+      pushItems[id].deadband = 0;
+    setPushInterval(DIAG_PUSH_INTERVAL);
+  } else {
+    pollPercent = 100;
+    setSampleInterval(SAMPLE_INTERVAL);
+    resetTagConfig();
+    setPushInterval(NEXT_INTERVAL);
+  }
+}
+
+void checkDiag() {
+  if (diagMode && diagTimeout.check())
+    setDiag(0);
+}
+
+// poll [<percent>] -- refresh periods of meter requests in percent of default ones
+void cmdPoll(char* args) {
+  char* arg = nextArg(args);
+  if (arg != nullptr)
+    pollPercent = constrain(atol(arg), MIN_POLL_PERCENT, MAX_POLL_PERCENT);
+  commandReply.print(pollPercent);
+}
+
+// push [<sec>] -- interval between uploads of data
+void cmdPush(char* args) {
+  char* arg = nextArg(args);
+  if (arg != nullptr)
+    setPushInterval(constrain(atol(arg), MIN_PUSH_SEC, MAX_PUSH_SEC) * Timeout::SECOND);
+  commandReply.print(pushInterval / Timeout::SECOND);
+}
+
+// sample [<ms>] -- interval of power samples, samples that were not uploaded yet are dropped
+void cmdSample(char* args) {
+  char* arg = nextArg(args);
+  if (arg != nullptr)
+    setSampleInterval(constrain(atol(arg), MIN_SAMPLE_INTERVAL, MAX_SAMPLE_INTERVAL));
+  commandReply.print(sampleInterval);
+}
+
+// agg [<sec>] -- window of aggregated values, they are uploaded at its end
+void cmdAgg(char* args) {
+  char* arg = nextArg(args);
+  if (arg != nullptr)
+    setAggWindow(constrain(atol(arg), MIN_AGG_SEC, MAX_AGG_SEC) * Timeout::SECOND);
+  commandReply.print(aggWindow / Timeout::SECOND);
+}
+
+// deadband <tag> [<value>[%]] -- change that is reported, in units of tag precision or in percent
+void cmdDeadband(char* args) {
+  PushItem* item = tagArg(args);
+  if (item == nullptr)
+    return;
+  char* arg = nextArg(args);
+  if (arg != nullptr) {
+    char* end;
+    item->deadband = max(strtol(arg, &end, 10), 0L);
+    item->percent = *end == '%';
+  }
+  commandReply.print(item->deadband);
+  if (item->percent)
+    commandReply.print('%');
+}
+
+// rate <tag> [fast|slow] -- rate class
+void cmdRate(char* args) {
+  PushItem* item = tagArg(args);
+  if (item == nullptr)
+    return;
+  char* arg = nextArg(args);
+  if (arg != nullptr && strcmp(arg, "fast") == 0)
+    item->rate = PUSH_FAST;
+  else if (arg != nullptr && strcmp(arg, "slow") == 0)
+    item->rate = PUSH_SLOW;
+  commandReply.print(item->rate == PUSH_FAST ? "fast" : "slow");
+}
+
+// diag [<min>] -- diagnostic mode for the given time, 0 -- ends it
+void cmdDiag(char* args) {
+  char* arg = nextArg(args);
+  if (arg != nullptr)
+    setDiag(constrain(atol(arg), 0, MAX_DIAG_MINUTES));
+  commandReply.print(diagMode ? "on" : "off");
+}
+
+void setupCommands() {
+  pushCommandRoute("poll", &cmdPoll);
+  pushCommandRoute("push", &cmdPush);
+  pushCommandRoute("sample", &cmdSample);
+  pushCommandRoute("agg", &cmdAgg);
+  pushCommandRoute("deadband", &cmdDeadband);
+  pushCommandRoute("rate", &cmdRate);
+  pushCommandRoute("diag", &cmdDiag);
 }
 
 //------- SETUP & MAIN -------
@@ -271,7 +473,12 @@ void setup() {
   // Http setup
   if (ethernetPresent) {
     httpServerRoute("/", &httpRoot);
-    httpServerRoute("/reset", &httpReset);
+    httpServerRoute("/stats", &httpStats, "text/plain"); // several CSV tables
+    httpServerRoute("/agg", &httpAggregates, "text/csv");
+    httpServerRoute("/reset", &httpReset, "text/plain");
+#ifdef CRC_BENCHMARK
+    httpServerRoute("/crc", &httpCRC, "text/plain");
+#endif
     httpServerSetup();
     // print http addr
     lcdLog.print(localIp);
@@ -281,7 +488,9 @@ void setup() {
   }
   // RS485 setup
   setupMercury();
+  setupAggregates();
   setupPushTags();
+  setupCommands();
 }
 
 void loop() {
@@ -289,14 +498,22 @@ void loop() {
     httpServerCheck();
     checkPush();
   }
+  checkDiag();
   bool blink = checkStatusBlink();
   bool mercury = checkMercury();
   bool button = checkButtons();
   bool up = checkUp();
-  if (blink || mercury || button || up) {
-    updateLCD(blink && validValues > 0);
+  if (mercury) lcdUpdatePending = true;
+  bool lcd = lcdUpdatePending && lcdUpdateTimeout.check();
+  if (blink || lcd || button || up) {
+    updateLCD(blink && meters[displayMeter].validValues > 0);
+    lcdUpdatePending = false;
+    lcdUpdateTimeout.reset(LCD_UPDATE_INTERVAL);
   }
   if (mercury) {
     pushData();
   }
+  if (checkAggregates()) {
+    pushAggregates();
+  }
 }
@@ -1,3 +1,5 @@
+#include <stddef.h>
+#include <avr/pgmspace.h>
 #include <Timeout.h>
 
 #include "Mercury.h"
@@ -5,366 +7,1035 @@
 
 //------- HARDWARE ------
 
+// #define RS485_SIMULATOR // poll simulated meter and report poll rate to SerialUSB, see also test/mercury_bench.cpp
+
+#ifdef RS485_SIMULATOR
+#include "MercurySim.h"
+#define rs485 mercurySim
+#else
 #define rs485 Serial
+#endif
 
 const int RS485_RTS_PIN = 9; // tx enable pin
-const long RS485_BAUD = 9600;
-const uint8_t RS485_ADDR = 0; // any device
+
+// supported baud rates, fastest first; the fastest one the meters answer at is used
+const long RS485_BAUDS[] = { 38400, 19200, 9600, 4800, 2400, 1200 };
+const uint8_t RS485_BAUDS_COUNT = sizeof(RS485_BAUDS) / sizeof(RS485_BAUDS[0]);
+
+// meter addresses, 0 -- any device (only when there is a single meter on the bus)
+const uint8_t RS485_ADDR[METERS] = { 0 };
 
 //------- TIMING ------
 
-const unsigned long RS485_TIMEOUT = 200;
+const unsigned long RS485_TIMEOUT = 200; // max wait for the first byte of response
 const unsigned long RS485_DELAY = 3;
+const unsigned long RS485_GAP = 5; // silence after the last byte that ends a frame, at least 3 bytes long
+const unsigned long RS485_MARGIN = 20; // added to learned response latency
+
+//------- BAUD RATE ------
+
+const uint8_t BAUD_WINDOW = 100; // requests in a window of baud rate reliability check
+const uint8_t BAUD_MAX_FAILURES = 10; // timeouts & CRC errors in a window that switch to a slower rate
+const unsigned long BAUD_RETRY_PERIOD = 3600000L; // 1 hour, try faster rate again after fallback
+const uint8_t BAUD_HISTORY = 8; // number of baud rate switches that are reported
+
+//------- STATISTICS ------
+
+const uint8_t LATENCY_BUCKETS = 5;
+const uint16_t LATENCY_BOUNDS[LATENCY_BUCKETS - 1] = { 20, 50, 100, 200 }; // ms
+
+//------- SCHEDULE ------
+
+// Request refresh periods
+const unsigned long POWER_PERIOD = 0; // every pass
+const unsigned long TIME_PERIOD = 1000; // 1 sec
+const unsigned long PHASE_PERIOD = 3000; // 3 sec
+const unsigned long TOTAL_ENERGY_PERIOD = 10000; // 10 sec, shown on default display page
+const unsigned long DAY_ENERGY_PERIOD = 60000; // 1 min
+const unsigned long MONTH_ENERGY_PERIOD = 300000; // 5 min
+const unsigned long YEAR_ENERGY_PERIOD = 900000; // 15 min
+const unsigned long PAST_ENERGY_PERIOD = 6 * 3600000L; // 6 hours, past periods change only on date change, see refreshEnergy
+const unsigned long PROFILE_INFO_PERIOD = 300000; // 5 min, check for new power profile records
+const unsigned long PROFILE_READ_PERIOD = 1000; // 1 sec, read stored power profile records while behind
+const unsigned long RETRY_DELAY = 1000; // 1 sec, failed request is polled again after it, doubled with every failure in a row
+const uint8_t RETRY_MAX_SHIFT = 8; // backoff stops growing, refresh period caps it anyway
+
+//------- POWER PROFILE ------
+
+const uint16_t PROFILE_BACKFILL = 48; // records read back on startup, 1 day of 30-min records
+const uint8_t PROFILE_FRAME_RECORDS = 4; // records read in one frame
+const uint8_t PROFILE_RECORD_SIZE = 16; // record size in meter memory
+const uint8_t PROFILE_RECORD_DATA = 15; // bytes of record that are read
+const long PROFILE_CONSTANT = 1000; // meter constant, imp/kWh
+
+//------- SESSION ------
+
+const unsigned long CHANNEL_IDLE_TIMEOUT = 120000; // 2 min, reopen channel if there was no successful response
+const uint8_t CHANNEL_TIMEOUTS = 3; // reopen channel after this number of timeouts in a row
 
 //------- PUBLIC STATE ------
 
-MercuryTime mercuryTime;
+Meter meters[METERS];
+uint8_t displayMeter;
 EnergyType displayEnergyType;
-
-fixnum32_1 volts[4];
-fixnum32_1 amps[4];
-fixnum32_1 watts[4];
-fixnum32_1 hertz;
-fixnum32_3 displayEnergy[TARIFFS + 1];
-fixnum32_3 curDayEnergy[TARIFFS + 1];
-fixnum32_3 prevDayEnergy[TARIFFS + 1];
-int8_t validValues = 0;
-int8_t expectedValues = 1;
-long mercuryUpdateTime = 0;
+uint16_t pollPercent = 100;
 
 //------- REQUESTS ------
 
-struct Req {
-  Req* next = nullptr;
-  virtual uint8_t req_size() = 0;
-  virtual uint8_t res_size() = 0;
-  virtual void request() = 0; // puts request in buf
-  virtual bool response() = 0; // parses response from buf
-  virtual void error(char* m) = 0; // called on error
-  int check(int state);  
-};
+// Response decoders
+const uint8_t D_STATUS = 0;       // status of open channel
+const uint8_t D_TIME = 1;         // meter time
+const uint8_t D_VALUE = 2;        // n 3-byte values of the given precision
+const uint8_t D_ENERGY = 3;       // 4-byte energy summary
+const uint8_t D_PROFILE_INFO = 4; // address and time of the last stored power profile record
+const uint8_t D_PROFILE = 5;      // stored power profile records
 
-struct OpenChannelReq : public Req {
-  virtual uint8_t req_size();
-  virtual uint8_t res_size();
-  virtual void request();
-  virtual bool response();
-  virtual void error(char* m);   
-};
+const uint8_t NO_GROUP = 0xff;
 
-struct ReadTimeReq : public Req {
-  virtual uint8_t req_size();
-  virtual uint8_t res_size();
-  virtual void request();
-  virtual bool response();
-  virtual void error(char* m);   
+// Request descriptor
+struct ReqDesc {
+  uint8_t func;     // function code
+  uint8_t param;    // parameter; energy type for D_ENERGY
+  uint8_t code;     // value code; tariff for D_ENERGY
+  uint8_t reqSize;  // request size with address and CRC
+  uint8_t resSize;  // response size with address and CRC, 0 -- computed on request
+  uint8_t decode;   // response decoder
+  prec_t prec;      // precision of D_VALUE
+  uint8_t n;        // number of values in response
+  uint16_t slot;    // offset of the first target value in Meter
+  uint8_t group;    // grouped request this per-phase request is a fallback of
+  unsigned long period; // refresh period, 0 -- every pass
 };
 
-template<prec_t prec> struct ReadValueReq : public Req {
-  fixnum32_1& value;
-  uint8_t code;
-  ReadValueReq(fixnum32_1& _value, uint8_t _code) : value(_value), code(_code) {}
-  virtual uint8_t req_size();
-  virtual uint8_t res_size();
-  virtual void request();
-  virtual bool response();
-  virtual void error(char* m);   
+#define SLOT(field) offsetof(Meter, field)
+
+// energy summary of the given type for each tariff
+#define ENERGY_REQS(type, period) \
+  { 0x05, type,         0,    6,  19, D_ENERGY,       0,   1, SLOT(energy[type][0]),   NO_GROUP, period }, \
+  { 0x05, type,         1,    6,  19, D_ENERGY,       0,   1, SLOT(energy[type][1]),   NO_GROUP, period }, \
+  { 0x05, type,         2,    6,  19, D_ENERGY,       0,   1, SLOT(energy[type][2]),   NO_GROUP, period },
+
+// Indices in REQ_TABLE
+enum {
+  R_OPEN,
+  R_TIME,
+  R_WATTS,
+  R_WATTS_0,
+  R_VOLTS,
+  R_AMPS,
+  R_VOLTS_1,
+  R_AMPS_1 = R_VOLTS_1 + 3,
+  R_WATTS_1 = R_AMPS_1 + 3,
+  R_HERTZ = R_WATTS_1 + 3,
+  R_ENERGY, // energy counters of all types and tariffs, in the order of EnergyType
+  R_ENERGY_LAST = R_ENERGY + ENERGY_TYPES * (TARIFFS + 1) - 1,
+  R_PROFILE_INFO,
+  R_PROFILE,
+  REQS
 };
 
-// num
+// All requests to a meter, due requests are polled in the order of this table within a pass.
+// Grouped reads of all phases (08h 16h) fall back to per-phase reads (08h 11h) when meter does not support them.
+//
+// energy param
 // x00 -- from reset
 // x10 -- for current year
 // x20 -- for previous year
 // x3x -- for month x
 // x40 -- for current day
 // x50 -- for prev day
-struct ReadEnergyReq : public Req {
-  fixnum32_3& value;
-  EnergyType type;
-  uint8_t tariff;
-  ReadEnergyReq(fixnum32_3& _value, EnergyType _type, uint8_t _tariff) : value(_value), type(_type), tariff(_tariff) {}  
-  virtual uint8_t req_size();
-  virtual uint8_t res_size();
-  virtual void request();
-  virtual bool response();
-  virtual void error(char* m);   
+const ReqDesc REQ_TABLE[REQS] PROGMEM = {
+  // func param         code  req res decode           prec n  slot                     group     period
+  { 0x01, 0x01,         0x00, 11, 4,  D_STATUS,       0,   0, 0,                       NO_GROUP, 0 }, // open channel, first level
+  { 0x04, 0x00,         0x00, 5,  11, D_TIME,         0,   0, SLOT(time),              NO_GROUP, TIME_PERIOD },
+  { 0x08, 0x16,         0x00, 6,  15, D_VALUE,        2,   4, SLOT(watts[0]),          NO_GROUP, POWER_PERIOD },
+  { 0x08, 0x11,         0x00, 6,  6,  D_VALUE,        2,   1, SLOT(watts[0]),          R_WATTS,  POWER_PERIOD },
+  { 0x08, 0x16,         0x11, 6,  12, D_VALUE,        2,   3, SLOT(volts[1]),          NO_GROUP, PHASE_PERIOD },
+  { 0x08, 0x16,         0x21, 6,  12, D_VALUE,        3,   3, SLOT(amps[1]),           NO_GROUP, PHASE_PERIOD },
+  { 0x08, 0x11,         0x11, 6,  6,  D_VALUE,        2,   1, SLOT(volts[1]),          R_VOLTS,  PHASE_PERIOD },
+  { 0x08, 0x11,         0x12, 6,  6,  D_VALUE,        2,   1, SLOT(volts[2]),          R_VOLTS,  PHASE_PERIOD },
+  { 0x08, 0x11,         0x13, 6,  6,  D_VALUE,        2,   1, SLOT(volts[3]),          R_VOLTS,  PHASE_PERIOD },
+  { 0x08, 0x11,         0x21, 6,  6,  D_VALUE,        3,   1, SLOT(amps[1]),           R_AMPS,   PHASE_PERIOD },
+  { 0x08, 0x11,         0x22, 6,  6,  D_VALUE,        3,   1, SLOT(amps[2]),           R_AMPS,   PHASE_PERIOD },
+  { 0x08, 0x11,         0x23, 6,  6,  D_VALUE,        3,   1, SLOT(amps[3]),           R_AMPS,   PHASE_PERIOD },
+  { 0x08, 0x11,         0x01, 6,  6,  D_VALUE,        2,   1, SLOT(watts[1]),          R_WATTS,  PHASE_PERIOD },
+  { 0x08, 0x11,         0x02, 6,  6,  D_VALUE,        2,   1, SLOT(watts[2]),          R_WATTS,  PHASE_PERIOD },
+  { 0x08, 0x11,         0x03, 6,  6,  D_VALUE,        2,   1, SLOT(watts[3]),          R_WATTS,  PHASE_PERIOD },
+  { 0x08, 0x11,         0x40, 6,  6,  D_VALUE,        2,   1, SLOT(hertz),             NO_GROUP, PHASE_PERIOD },
+  ENERGY_REQS(E_TOTAL,      TOTAL_ENERGY_PERIOD)
+  ENERGY_REQS(E_CUR_DAY,    DAY_ENERGY_PERIOD)
+  ENERGY_REQS(E_PREV_DAY,   PAST_ENERGY_PERIOD)
+  ENERGY_REQS(E_CUR_MONTH,  MONTH_ENERGY_PERIOD)
+  ENERGY_REQS(E_PREV_MONTH, PAST_ENERGY_PERIOD)
+  ENERGY_REQS(E_PR_2_MONTH, PAST_ENERGY_PERIOD)
+  ENERGY_REQS(E_CUR_YEAR,   YEAR_ENERGY_PERIOD)
+  ENERGY_REQS(E_PREV_YEAR,  PAST_ENERGY_PERIOD)
+  { 0x08, 0x13,         0x00, 5,  12, D_PROFILE_INFO, 0,   0, 0,                       NO_GROUP, PROFILE_INFO_PERIOD },
+  { 0x06, 0x03,         0x00, 8,  0,  D_PROFILE,      0,   0, 0,                       NO_GROUP, PROFILE_READ_PERIOD },
+};
+
+static_assert(TARIFFS == 2, "ENERGY_REQS lists requests for each tariff");
+
+//------- REQUEST STATE ------
+
+// counters stop at 65535, latency sum stops with n_ok so that average stays right
+struct ReqStats {
+  uint16_t n_ok = 0;
+  uint16_t n_timeout = 0;
+  uint16_t n_crc = 0;
+  uint16_t n_bad = 0; // short frames, meter errors & bad responses
+  uint16_t lat_min = 0xffff;
+  uint16_t lat_max = 0;
+  unsigned long lat_sum = 0;
+  uint16_t lat_hist[LATENCY_BUCKETS] = {};
+};
+
+// state of a request to a meter
+struct ReqState {
+  Timeout due; // when this request shall be polled again
+  bool valid = false; // last poll was successful
+  bool enabled = true; // disabled requests are not polled
+  bool supported = false; // meter has responded to grouped read
+  uint8_t failures = 0; // rejections of grouped read
+  uint8_t retries = 0; // failures in a row
+  uint16_t latency = RS485_TIMEOUT; // decaying max of response latency, ms
+};
+
+// requests and pass state of each meter
+struct MeterPoll {
+  ReqState reqs[REQS];
+  long updateStart;
+  bool channelOpen; // channel session stays open across passes
+  Timeout channelIdle;
+  uint8_t timeouts; // timeouts in a row
+  // power profile readout
+  bool profileKnown; // address of the last record is known
+  uint16_t profileNext; // address of the next record to read
+  uint16_t profileLast; // address of the last stored record
+  uint8_t profileN; // records in current request
 };
 
 //------- REQUEST/RESPONSE STATE ------
 
-const uint8_t BUF_SIZE = 20;
+const uint8_t BUF_SIZE = 3 + PROFILE_FRAME_RECORDS * PROFILE_RECORD_SIZE;
+const uint8_t GROUP_FAILURES = 3; // rejections of grouped read by meter before falling back to per-phase reads
 uint8_t buf[BUF_SIZE];
-uint8_t n_read;
-Timeout timeout;
+uint8_t res_size;
+uint8_t res_error; // error code of the last failed request
+
+// res_error codes, below 0x10 -- error codes from meter error frame
+const uint8_t ERR_PARAM = 0x01; // invalid command or parameter
+const uint8_t ERR_ACCESS = 0x03; // insufficient access level
+const uint8_t ERR_CHANNEL = 0x05; // channel is not open
+const uint8_t ERR_TIMEOUT = 0x10;
+const uint8_t ERR_FRAME = 0x11;
+const uint8_t ERR_CRC = 0x12;
+const uint8_t ERR_RESPONSE = 0x13;
+
+const uint8_t ERR_SIZE = 4; // size of meter error frame
+
+char NO_CHANNEL[] = "no channel";
 
 const int S_ERROR = -1;
 const int S_SUCCESS = -2;
 
-//------- Req ------
-
-int Req::check(int state) {
-  switch(state) {
-  case 0:
-    request();
-    computeCRC(buf, req_size() - 2);
-    // drain read buffer before making request
-    while (rs485.available())
-      rs485.read();
-    // prepare to write request
-    digitalWrite(RS485_RTS_PIN, 1); // write
-    timeout.reset(RS485_DELAY); // wait before actually writing
-    return 1; 
-  case 1:
-    if (!timeout.check()) return 1; // wait more
-    rs485.write(buf, req_size());
-    rs485.flush();
-    digitalWrite(RS485_RTS_PIN, 0); // read
-    n_read = 0;
-    timeout.reset(RS485_TIMEOUT);
-    return 2;
-  case 2:
-    uint8_t res_size = this->res_size();
-    while (n_read < res_size && rs485.available()) {
-      buf[n_read++] = rs485.read();
+//------- TOP-LEVEL STATE ------
+
+MeterPoll polls[METERS];
+uint8_t cur_meter;
+uint8_t cur_index = REQS; // current request, REQS -- none
+ReqDesc cur_desc; // descriptor of current request
+int cur_state;
+uint8_t lastDisplayMeter;
+EnergyType lastDisplayEnergyType = E_TOTAL;
+unsigned long bus_start; // when current request has started
+unsigned long bus_time; // total time of all requests
+
+//------- ENGINE ------
+
+void loadDesc(uint8_t index, ReqDesc& desc) {
+  memcpy_P(&desc, &REQ_TABLE[index], sizeof(ReqDesc));
+}
+
+// i-th target value of request in meter
+template<typename T> T& slot(Meter& meter, ReqDesc& desc, uint8_t i) {
+  return ((T*)((uint8_t*)&meter + desc.slot))[i];
+}
+
+uint8_t bcd(uint8_t x) {
+  return (x >> 4) * 10 + (x & 0x0f);
+}
+
+uint8_t energyNum(Meter& meter, uint8_t type) {
+  switch(type) {
+    case E_TOTAL: return 0x00;
+    case E_CUR_DAY: return 0x40;
+    case E_PREV_DAY: return 0x50;
+    case E_CUR_MONTH: return 0x30 + meter.time.month;
+    case E_PREV_MONTH: return 0x30 + (meter.time.month + 10) % 12 + 1;
+    case E_PR_2_MONTH: return 0x30 + (meter.time.month + 9) % 12 + 1;
+    case E_CUR_YEAR: return 0x10;
+    case E_PREV_YEAR: return 0x20;
+  }
+  return 0x00;
+}
+
+// number of records till the last one, inclusive, 0 or less -- caught up
+int16_t profileBehind(MeterPoll& poll) {
+  return (int16_t)(poll.profileLast - poll.profileNext) / PROFILE_RECORD_SIZE + 1;
+}
+
+// puts request in buf and computes expected response size
+void request(Meter& meter, MeterPoll& poll, ReqDesc& desc) {
+  buf[0] = meter.addr;
+  buf[1] = desc.func;
+  buf[2] = desc.param;
+  buf[3] = desc.code;
+  res_size = desc.resSize;
+  switch (desc.decode) {
+  case D_STATUS:
+    for (uint8_t i = 3; i < 9; i++)
+      buf[i] = 0x01; // password
+    break;
+  case D_ENERGY:
+    buf[2] = energyNum(meter, desc.param);
+    break;
+  case D_PROFILE: {
+    int16_t behind = profileBehind(poll); // at least one, see D_PROFILE_INFO
+    uint8_t n = behind < PROFILE_FRAME_RECORDS ? behind : PROFILE_FRAME_RECORDS;
+    uint8_t bytes = (n - 1) * PROFILE_RECORD_SIZE + PROFILE_RECORD_DATA;
+    poll.profileN = n;
+    buf[3] = poll.profileNext >> 8;
+    buf[4] = poll.profileNext;
+    buf[5] = bytes;
+    res_size = 3 + bytes;
+    break;
+  }
+  }
+}
+
+template<prec_t prec> void decodeValues(Meter& meter, ReqDesc& desc) {
+  for (uint8_t i = 0; i < desc.n; i++) {
+    uint8_t* b = buf + 1 + 3 * i;
+    int32_t v = ((uint32_t)(b[0] & (uint8_t)0x3f) << 16) |
+      ((uint32_t)b[1]) | ((uint32_t)b[2] << 8);
+    slot<fixnum32_1>(meter, desc, i) = FixNum<int32_t, prec>(v); // interpret as specified precision & convert to target value
+  }
+}
+
+// record: status, hour, minute, date, month, year (BCD), period (min), P+, P-, Q+, Q- (low byte first)
+void decodeProfile(Meter& meter, MeterPoll& poll, ReqState& state) {
+  uint8_t n = poll.profileN;
+  for (uint8_t i = 0; i < n; i++) {
+    uint8_t* r = buf + 1 + i * PROFILE_RECORD_SIZE;
+    uint16_t pulses = r[7] | ((uint16_t)r[8] << 8);
+    uint8_t period = r[6];
+    if (period == 0 || period == 0xff || pulses == 0xffff) continue; // empty record
+    if (meter.profileCount == PROFILE_SIZE) {
+      // not pushed yet -- drop the oldest record
+      memmove(meter.profile, meter.profile + 1, (PROFILE_SIZE - 1) * sizeof(ProfileRecord));
+      meter.profileCount--;
     }
-    if (n_read < res_size) {
-      if (!timeout.check()) return 2; // wait more
-      error("timeout"); // timed out
-      return S_ERROR;
+    ProfileRecord& rec = meter.profile[meter.profileCount++];
+    rec.time.second = 0;
+    rec.time.minute = bcd(r[2]);
+    rec.time.hour = bcd(r[1]);
+    rec.time.date = bcd(r[3]);
+    rec.time.month = bcd(r[4]);
+    rec.time.year = bcd(r[5]);
+    // average power, W: pulses * 60 / period / (2 * A) kW
+    rec.watts = fixnum32_1((int32_t)((uint32_t)pulses * (600000L / (2 * PROFILE_CONSTANT)) / period));
+  }
+  poll.profileNext += n * PROFILE_RECORD_SIZE;
+  if (profileBehind(poll) <= 0)
+    state.due = Timeout(); // not due till D_PROFILE_INFO reports a new record
+}
+
+// cached counters of past periods change only when meter date changes
+void refreshEnergy(MeterPoll& poll) {
+  for (uint8_t i = R_ENERGY; i <= R_ENERGY_LAST; i++)
+    poll.reqs[i].due.reset(0);
+}
+
+// parses response from buf
+bool response(Meter& meter, MeterPoll& poll, ReqDesc& desc, ReqState& state) {
+  switch (desc.decode) {
+  case D_STATUS:
+    return buf[1] == 0x00; // Ok
+  case D_TIME: {
+    uint8_t date = meter.time.date;
+    meter.time.second = bcd(buf[1]);
+    meter.time.minute = bcd(buf[2]);
+    meter.time.hour = bcd(buf[3]);
+    meter.time.date = bcd(buf[5]);
+    meter.time.month = bcd(buf[6]);
+    meter.time.year = bcd(buf[7]);
+    if (date != meter.time.date) refreshEnergy(poll); // also on first read, before energy is polled
+    return true;
+  }
+  case D_VALUE:
+    switch (desc.prec) {
+      case 2: decodeValues<2>(meter, desc); break;
+      case 3: decodeValues<3>(meter, desc); break;
+      default: return false;
     }
-    uint8_t c0 = buf[res_size - 2];
-    uint8_t c1 = buf[res_size - 1];
-    computeCRC(buf, res_size - 2);
-    bool ok = c0 == buf[res_size - 2] && c1 == buf[res_size - 1];
-    if (!ok) {
-       error("CRC"); // CRC error
-       return S_ERROR;
+    state.supported = true;
+    return true;
+  case D_ENERGY: {
+    int32_t v = (uint32_t)buf[3] |
+      ((uint32_t)buf[4] << 8) |
+      ((uint32_t)buf[1] << 16) |
+      ((uint32_t)buf[2] << 24);
+    slot<fixnum32_3>(meter, desc, 0) = fixnum32_3(v);
+    return true;
+  }
+  case D_PROFILE_INFO: {
+    uint16_t addr = ((uint16_t)buf[1] << 8) | buf[2];
+    if (poll.profileKnown && addr == poll.profileLast) return true; // no new records
+    poll.profileLast = addr;
+    int16_t behind = profileBehind(poll);
+    if (!poll.profileKnown || behind <= 0 || behind > PROFILE_BACKFILL) {
+      // first read, meter memory was cleared or records were missed while meter did not answer
+      poll.profileNext = addr - (PROFILE_BACKFILL - 1) * PROFILE_RECORD_SIZE;
     }
-    // parse response
-    if (!response()) {
-      error("bad response");
-      return S_ERROR; 
+    if (!poll.profileKnown) {
+      // profile is not read from meters that do not answer this request
+      poll.profileKnown = true;
+      poll.reqs[R_PROFILE].enabled = true;
+      meter.expectedValues++;
     }
-    return S_SUCCESS; // done
-  } 
+    poll.reqs[R_PROFILE].due.reset(0); // new records to read
+    return true;
+  }
+  case D_PROFILE:
+    decodeProfile(meter, poll, state);
+    return true;
+  }
+  return false;
 }
 
-//------- OpenChannelReq ------
-
-uint8_t OpenChannelReq::req_size() { return 11; }
-
-void OpenChannelReq::request() {
-  buf[0] = RS485_ADDR;
-  buf[1] = 0x01; // open channel
-  buf[2] = 0x01; // first level
-  for (uint8_t i = 3; i < 9; i++)
-    buf[i] = 0x01; // password  
+// switches grouped read to per-phase reads if meter keeps rejecting it and it has never worked,
+// timeouts and line errors say nothing about support
+void checkGroup(Meter& meter, MeterPoll& poll, uint8_t index, ReqState& state) {
+  if (!state.enabled || state.supported || ++state.failures < GROUP_FAILURES) return;
+  SerialUSB.print("Grouped read not supported: ");
+  SerialUSB.println(index);
+  state.enabled = false;
+  meter.expectedValues--;
+  ReqDesc desc;
+  for (uint8_t i = 0; i < REQS; i++) {
+    loadDesc(i, desc);
+    if (desc.group != index) continue;
+    poll.reqs[i].enabled = true;
+    poll.reqs[i].due.reset(0);
+    meter.expectedValues++;
+  }
 }
 
-uint8_t OpenChannelReq::res_size() { return 4; }
+// called on error
+void error(Meter& meter, MeterPoll& poll, uint8_t index, ReqDesc& desc, char* m) {
+  ReqState& state = poll.reqs[index];
+  switch (desc.decode) {
+  case D_STATUS:
+    SerialUSB.print("Channel err: ");
+    SerialUSB.println(m);
+    break;
+  case D_VALUE:
+    for (uint8_t i = 0; i < desc.n; i++)
+      slot<fixnum32_1>(meter, desc, i) = fixnum32_1(INVALID_VALUE);
+    if (desc.n > 1 && m != NO_CHANNEL && res_error == ERR_PARAM) checkGroup(meter, poll, index, state);
+    break;
+  case D_ENERGY:
+    slot<fixnum32_3>(meter, desc, 0) = fixnum32_3(INVALID_VALUE);
+    break;
+  }
+}
 
-bool OpenChannelReq::response() {
-  return buf[1] == 0x00; // Ok
+// response timeout is learned from observed latencies
+unsigned long responseTimeout(ReqState& state) {
+  unsigned long t = state.latency + state.latency / 2 + RS485_MARGIN;
+  return t < RS485_TIMEOUT ? t : RS485_TIMEOUT;
 }
 
-void OpenChannelReq::error(char* m) {
-  SerialUSB.print("Channel err: ");
-  SerialUSB.println(m);
+// tracks max latency that decays by 1/8 with every response
+void learnLatency(ReqState& state, unsigned long t) {
+  uint16_t decayed = state.latency - state.latency / 8;
+  state.latency = t > decayed ? t : decayed;
 }
 
-//------- ReadTimeReq ------
+//------- FRAME ENGINE ------
+
+// Sends request frame from buf and assembles response frame in buf without blocking loop().
+// Received bytes are buffered by UART interrupt handler, CRC is checked as they arrive,
+// RTS is dropped when the last byte is transmitted.
+
+const int F_BUSY = 0;
+const int F_FRAME = 1;   // complete frame with correct CRC
+const int F_CRC = 2;     // complete frame with wrong CRC
+const int F_SHORT = 3;   // frame ended by silence before expected size
+const int F_TIMEOUT = 4; // no response
 
-uint8_t ReadTimeReq::req_size() { return 5; }
+const uint8_t FS_IDLE = 0;
+const uint8_t FS_DELAY = 1;   // RTS is up, wait before writing
+const uint8_t FS_TX = 2;      // writing bytes as UART accepts them
+const uint8_t FS_TX_DONE = 3; // wait till the last byte is transmitted
+const uint8_t FS_RX = 4;      // receiving response
 
-void ReadTimeReq::request() {
-  buf[0] = RS485_ADDR;
-  buf[1] = 0x04; // read time
-  buf[2] = 0x00; // param
+uint8_t frame_state;
+uint8_t tx_size;
+uint8_t tx_pos;
+unsigned long tx_start; // us
+unsigned long tx_end; // us
+unsigned long char_us; // time to transmit one byte at current baud rate, us
+unsigned long rx_timeout;
+uint8_t n_read;
+uint8_t rx_crc[2];
+Timeout timeout;
+Timeout gap;
+unsigned long rs485_gap = RS485_GAP;
+unsigned long sent_time;
+unsigned long res_latency; // time from sending request till the first byte of response
+unsigned long res_time; // time from sending request till complete response
+
+// starts sending request frame of the given size from buf, response is expected within timeout
+void sendFrame(uint8_t size, unsigned long timeout_ms) {
+  tx_size = size;
+  rx_timeout = timeout_ms;
+  // drain read buffer before making request
+  while (rs485.available())
+    rs485.read();
+  // prepare to write request
+  digitalWrite(RS485_RTS_PIN, 1); // write
+  timeout.reset(RS485_DELAY); // wait before actually writing
+  frame_state = FS_DELAY;
 }
 
-uint8_t ReadTimeReq::res_size() { return 11; }
+// CRC of received frame is correct
+bool frameCRC() {
+  return rx_crc[0] == 0 && rx_crc[1] == 0;
+}
 
-uint8_t bcd(uint8_t x) {
-  return (x >> 4) * 10 + (x & 0x0f);
+int checkFrame() {
+  switch (frame_state) {
+  case FS_DELAY:
+    if (!timeout.check()) return F_BUSY; // wait more
+    tx_pos = 0;
+    tx_start = micros();
+    frame_state = FS_TX;
+    // falls through
+  case FS_TX:
+    while (tx_pos < tx_size && rs485.availableForWrite() > 0)
+      rs485.write(buf[tx_pos++]);
+    if (tx_pos < tx_size) return F_BUSY; // UART is busy
+    // bytes are transmitted one after another from start or are still in UART
+    tx_end = tx_start + tx_size * char_us;
+    if ((long)(micros() + char_us - tx_end) > 0) tx_end = micros() + char_us;
+    frame_state = FS_TX_DONE;
+    // falls through
+  case FS_TX_DONE:
+    if ((long)(micros() - tx_end) < 0) return F_BUSY; // still transmitting
+    digitalWrite(RS485_RTS_PIN, 0); // read
+    n_read = 0;
+    rx_crc[0] = 0xff;
+    rx_crc[1] = 0xff;
+    sent_time = millis();
+    timeout.reset(rx_timeout);
+    frame_state = FS_RX;
+    // falls through
+  case FS_RX:
+    while (n_read < res_size && rs485.available()) {
+      if (n_read == 0) res_latency = millis() - sent_time;
+      uint8_t c = rs485.read();
+      buf[n_read++] = c;
+      updateCRC(rx_crc, c);
+      gap.reset(rs485_gap);
+    }
+    if (n_read == 0) {
+      if (!timeout.check()) return F_BUSY; // wait more
+      frame_state = FS_IDLE;
+      return F_TIMEOUT;
+    }
+    if (n_read < res_size) {
+      if (!gap.check()) return F_BUSY; // wait more
+      frame_state = FS_IDLE;
+      return F_SHORT;
+    }
+    res_time = millis() - sent_time;
+    frame_state = FS_IDLE;
+    return frameCRC() ? F_FRAME : F_CRC;
+  }
+  return F_TIMEOUT;
 }
 
-bool ReadTimeReq::response() {
-  mercuryTime.second = bcd(buf[1]);
-  mercuryTime.minute = bcd(buf[2]);
-  mercuryTime.hour = bcd(buf[3]);
-  mercuryTime.date = bcd(buf[5]);
-  mercuryTime.month = bcd(buf[6]);
-  mercuryTime.year = bcd(buf[7]);
-  return true;
+//------- REQUEST EXECUTION ------
+
+// executes current request
+int checkReq(int state) {
+  Meter& meter = meters[cur_meter];
+  MeterPoll& poll = polls[cur_meter];
+  ReqState& req = poll.reqs[cur_index];
+  if (state == 0) {
+    loadDesc(cur_index, cur_desc);
+    request(meter, poll, cur_desc);
+    computeCRC(buf, cur_desc.reqSize - 2);
+    sendFrame(cur_desc.reqSize, responseTimeout(req));
+    return 1;
+  }
+  int frame = checkFrame();
+  if (frame == F_BUSY) return 1; // wait more
+  if (frame == F_TIMEOUT) {
+    req.latency = RS485_TIMEOUT; // relearn from full timeout
+    res_error = ERR_TIMEOUT;
+    error(meter, poll, cur_index, cur_desc, "timeout"); // timed out
+    return S_ERROR;
+  }
+  learnLatency(req, res_latency);
+  if (frame == F_SHORT) {
+    // silence in the middle of the frame -- short error frame or lost bytes
+    if (n_read != ERR_SIZE || !frameCRC()) {
+      res_error = ERR_FRAME;
+      error(meter, poll, cur_index, cur_desc, "short frame");
+      return S_ERROR;
+    }
+    res_error = buf[1] & 0x0f;
+    error(meter, poll, cur_index, cur_desc, "meter error");
+    return S_ERROR;
+  }
+  if (frame == F_CRC) {
+    res_error = ERR_CRC;
+    error(meter, poll, cur_index, cur_desc, "CRC"); // CRC error
+    return S_ERROR;
+  }
+  // parse response
+  if (!response(meter, poll, cur_desc, req)) {
+    res_error = ERR_RESPONSE;
+    error(meter, poll, cur_index, cur_desc, "bad response");
+    return S_ERROR;
+  }
+  return S_SUCCESS; // done
 }
 
-void ReadTimeReq::error(char* m) {}
+//------- STATISTICS ------
 
-//------- ReadValueReq ------
+// statistics are kept per request type and per meter, not for each request of each meter
+ReqStats reqStats[REQS];
+ReqStats meterStats[METERS];
 
-const int32_t INVALID_VALUE = 0x7fffffffL;
+void countUp(uint16_t& n) {
+  if (n != 0xffff) n++;
+}
 
-template<prec_t prec> uint8_t ReadValueReq<prec>::req_size() { return 6; }
+void countStats(ReqStats& stats, bool success) {
+  if (success) {
+    uint16_t t = res_time;
+    if (t < stats.lat_min) stats.lat_min = t;
+    if (t > stats.lat_max) stats.lat_max = t;
+    if (stats.n_ok != 0xffff) {
+      stats.n_ok++;
+      stats.lat_sum += t;
+    }
+    uint8_t i = 0;
+    while (i < LATENCY_BUCKETS - 1 && t >= LATENCY_BOUNDS[i]) i++;
+    countUp(stats.lat_hist[i]);
+    return;
+  }
+  switch (res_error) {
+    case ERR_TIMEOUT: countUp(stats.n_timeout); break;
+    case ERR_CRC: countUp(stats.n_crc); break;
+    default: countUp(stats.n_bad);
+  }
+}
 
-template<prec_t prec> void ReadValueReq<prec>::request() {
-  buf[0] = RS485_ADDR;
-  buf[1] = 0x08; // read
-  buf[2] = 0x11; // extra params
-  buf[3] = code;
+void printHex(Print& out, uint8_t x) {
+  if (x < 0x10) out.print('0');
+  out.print(x, HEX);
 }
 
-template<prec_t prec> uint8_t ReadValueReq<prec>::res_size() { return 6; }
+void printReqName(Print& out, uint8_t index) {
+  ReqDesc desc;
+  loadDesc(index, desc);
+  printHex(out, desc.func);
+  out.print(':');
+  printHex(out, desc.param);
+  out.print(':');
+  printHex(out, desc.code);
+}
 
-template<prec_t prec> bool ReadValueReq<prec>::response() {
-  int32_t v = ((uint32_t)(buf[1] & (uint8_t)0x3f) << 16) |
-    ((uint32_t)buf[2]) | ((uint32_t)buf[3] << 8);
-  value = FixNum<int32_t, prec>(v); // interpret as specified precision & convert to target value 
-  return true;
+// CSV: ok,timeout,crc,bad,min,avg,max,histogram...
+void printStats(Print& out, ReqStats& stats) {
+  out.print(stats.n_ok);
+  out.print(',');
+  out.print(stats.n_timeout);
+  out.print(',');
+  out.print(stats.n_crc);
+  out.print(',');
+  out.print(stats.n_bad);
+  out.print(',');
+  out.print(stats.n_ok > 0 ? stats.lat_min : 0);
+  out.print(',');
+  out.print(stats.n_ok > 0 ? stats.lat_sum / stats.n_ok : 0);
+  out.print(',');
+  out.print(stats.lat_max);
+  for (uint8_t i = 0; i < LATENCY_BUCKETS; i++) {
+    out.print(',');
+    out.print(stats.lat_hist[i]);
+  }
+  out.println();
 }
 
-template<prec_t prec> void ReadValueReq<prec>::error(char* m) {
-  value = fixnum32_1(INVALID_VALUE);
+//------- BENCHMARK ------
+
+#ifdef RS485_SIMULATOR
+
+const unsigned long BENCH_INTERVAL = 10000; // 10 sec
+
+Timeout benchTimeout(BENCH_INTERVAL);
+unsigned long benchStart;
+long benchPasses;
+long benchRequests;
+
+void checkBench() {
+  if (!benchTimeout.check()) return;
+  unsigned long time = millis() - benchStart;
+  SerialUSB.print("Bench: ");
+  SerialUSB.print(benchPasses * 1000.0 / time);
+  SerialUSB.print(" passes/s, ");
+  SerialUSB.print(benchRequests > 0 ? (float)time / benchRequests : 0.0);
+  SerialUSB.println(" ms/request");
+  benchStart = millis();
+  benchPasses = 0;
+  benchRequests = 0;
+  benchTimeout.reset(BENCH_INTERVAL);
 }
 
-//------- ReadEnergyReq ------
+#endif
 
-uint8_t ReadEnergyReq::req_size() { return 6; }
+//------- BAUD RATE SELECTION ------
 
-void ReadEnergyReq::request() {
-  uint8_t num = 0;
-  switch(type) {
-    case E_TOTAL: num = 0x00; break;
-    case E_CUR_DAY: num = 0x40; break;
-    case E_PREV_DAY: num = 0x50; break;
-    case E_CUR_MONTH: num = 0x30 + mercuryTime.month; break;
-    case E_PREV_MONTH: num = 0x30 + (mercuryTime.month + 10) % 12 + 1; break;
-    case E_PR_2_MONTH: num = 0x30 + (mercuryTime.month + 9) % 12 + 1; break;
-    case E_CUR_YEAR: num = 0x10; break;
-    case E_PREV_YEAR: num = 0x20; break;
+struct BaudSwitch {
+  unsigned long time;
+  long baud;
+  char reason; // 'p' -- probe, 'f' -- fallback on errors, 'r' -- retry faster rate
+};
+
+uint8_t baud_index; // index in RS485_BAUDS
+uint8_t best_baud_index = RS485_BAUDS_COUNT; // fastest rate that worked
+bool baud_probing = true; // not every meter was tried at current rate yet
+uint8_t baud_requests; // requests in current window
+uint8_t baud_failures; // timeouts & CRC errors in current window
+Timeout baudRetry;
+BaudSwitch baud_history[BAUD_HISTORY];
+uint8_t baud_history_size;
+// probing sweeps rates from probe_start till all meters answer at one of them
+uint8_t probe_start;
+uint16_t probe_tried; // meters that were tried at current rate, bit per meter
+uint16_t probe_answered; // meters that answered at current rate
+uint8_t probe_best = RS485_BAUDS_COUNT; // rate most meters answered at in this sweep
+uint8_t probe_best_count;
+
+static_assert(METERS <= 16, "probing keeps bit per meter");
+
+const uint16_t ALL_METERS = (1UL << METERS) - 1;
+
+void setBaud(uint8_t index, char reason) {
+  baud_index = index;
+  long baud = RS485_BAUDS[index];
+  rs485.end();
+  rs485.begin(baud);
+  char_us = 11000000L / baud; // start, 8 data, parity & stop bits
+  unsigned long gap = 3 * 11000 / baud + 1;
+  rs485_gap = gap > RS485_GAP ? gap : RS485_GAP;
+  baud_requests = 0;
+  baud_failures = 0;
+  probe_tried = 0;
+  probe_answered = 0;
+  if (baud_history_size == BAUD_HISTORY) {
+    memmove(baud_history, baud_history + 1, (BAUD_HISTORY - 1) * sizeof(BaudSwitch));
+    baud_history_size--;
   }
-  buf[0] = RS485_ADDR;
-  buf[1] = 0x05; // read summaries
-  buf[2] = num;  // what kind of energy
-  buf[3] = tariff; // tariff
+  baud_history[baud_history_size++] = BaudSwitch{millis(), baud, reason};
+  SerialUSB.print("RS485 baud: ");
+  SerialUSB.println(baud);
 }
 
-uint8_t ReadEnergyReq::res_size() { return 19; }
-
-bool ReadEnergyReq::response() {
-  int32_t v = (uint32_t)buf[3] |
-    ((uint32_t)buf[4] << 8) |
-    ((uint32_t)buf[1] << 16) |
-    ((uint32_t)buf[2] << 24);;
-  value = fixnum32_3(v);  
-  return true;
+// meters keep their configured rate, so any switch is verified with every meter
+void startProbe(uint8_t index, char reason) {
+  setBaud(index, reason);
+  baud_probing = true;
+  probe_start = index;
+  probe_best_count = 0;
 }
 
-void ReadEnergyReq::error(char* m) {
-  value = fixnum32_3(INVALID_VALUE);
+uint8_t countMeters(uint16_t bits) {
+  uint8_t n = 0;
+  for (; bits != 0; bits &= bits - 1)
+    n++;
+  return n;
 }
 
-//------- TOP-LEVEL STATE ------
+// not all meters answered at current rate -- try the next one, after full sweep settle
+// at the rate most meters answered at, so that a mixed-rate bus still serves most of them
+void nextProbe() {
+  uint8_t n = countMeters(probe_answered);
+  if (n > probe_best_count) {
+    probe_best = baud_index;
+    probe_best_count = n;
+  }
+  uint8_t next = (baud_index + 1) % RS485_BAUDS_COUNT;
+  if (next != probe_start) {
+    setBaud(next, 'p');
+    return;
+  }
+  if (probe_best_count == 0) {
+    startProbe(next, 'p'); // nobody answers -- sweep again
+    return;
+  }
+  SerialUSB.print("RS485 meters at other rates: ");
+  SerialUSB.println(METERS - probe_best_count);
+  setBaud(probe_best, 'p');
+  baud_probing = false;
+}
 
-OpenChannelReq openChannel;
-Req* last_req = &openChannel;
-Req* cur_req = nullptr;
-int cur_state;
-int ok_values;
-ReadEnergyReq* displayEnergyReq[TARIFFS+1];
-EnergyType lastDisplayEnergyType = E_TOTAL;
-bool refreshDisplayEnergy;
-long mercuryUpdateStart;
+// checks reliability of current baud rate on every response
+void checkBaud(bool success) {
+  if (baud_probing) {
+    uint16_t bit = 1 << cur_meter;
+    if (success)
+      probe_answered |= bit;
+    if (success || cur_index == R_OPEN)
+      probe_tried |= bit; // no answer to open channel -- meter does not talk at this rate
+    if (probe_tried != ALL_METERS)
+      return;
+    if (probe_answered != ALL_METERS) {
+      nextProbe();
+      return;
+    }
+    baud_probing = false;
+    if (baud_index < best_baud_index) best_baud_index = baud_index;
+    return;
+  }
+  if (!success && (res_error == ERR_TIMEOUT || res_error == ERR_CRC))
+    baud_failures++;
+  if (baud_failures >= BAUD_MAX_FAILURES) {
+    // meters do not change rate by themselves -- check they still answer at this one before leaving it
+    startProbe(baud_index, 'f');
+    baudRetry.reset(BAUD_RETRY_PERIOD);
+    return;
+  }
+  if (++baud_requests >= BAUD_WINDOW) {
+    baud_requests = 0;
+    baud_failures = 0;
+  }
+  if (baud_index > best_baud_index && baudRetry.check())
+    startProbe(best_baud_index, 'r');
+}
 
 //------- TOP-LEVEL SETUP/CHECK ------
 
-void add(Req* req) {
-  last_req->next = req;
-  last_req = req;
-  expectedValues++;
-}
+void nextDueReq();
 
 void reinitLoop() {
-  cur_req = &openChannel;
+  MeterPoll& poll = polls[cur_meter];
+  cur_index = R_OPEN;
   cur_state = 0;
-  ok_values = 0;
-  for (uint8_t i = 0; i <= TARIFFS; i++)
-    displayEnergyReq[i]->type = displayEnergyType;
-  mercuryUpdateStart = millis();  
+  poll.updateStart = millis();  
+  if (poll.channelIdle.check())
+    poll.channelOpen = false; // meter may have closed it
+  if (poll.channelOpen)
+    nextDueReq(); // skip open channel request
+}
+
+void setupMeter(uint8_t m) {
+  Meter& meter = meters[m];
+  MeterPoll& poll = polls[m];
+  meter.addr = RS485_ADDR[m];
+  ReqDesc desc;
+  for (uint8_t i = 0; i < REQS; i++) {
+    loadDesc(i, desc);
+    ReqState& req = poll.reqs[i];
+    req.enabled = desc.group == NO_GROUP && i != R_PROFILE; // per-phase fallbacks & profile are enabled when needed
+    req.due.reset(0);
+    if (req.enabled) meter.expectedValues++;
+  }
 }
 
 void setupMercury() {
   // init hardware
-  rs485.begin(RS485_BAUD);
+  startProbe(0, 'p');
   pinMode(RS485_RTS_PIN, OUTPUT);
-  // allocate requests
-  add(new ReadTimeReq());
-  // display energy does first after time
-  for (uint8_t i = 0; i <= TARIFFS; i++)
-    add(displayEnergyReq[i] = new ReadEnergyReq(displayEnergy[i], E_TOTAL, i));
-  // the rest of it  
-  for (uint8_t i = 1; i <= 3; i++)
-    add(new ReadValueReq<2>(volts[i], 0x10 + i));
-  for (uint8_t i = 1; i <= 3; i++)
-    add(new ReadValueReq<3>(amps[i], 0x20 + i));
-  for (uint8_t i = 0; i <= 3; i++)
-    add(new ReadValueReq<2>(watts[i], 0x00 + i));
-  add(new ReadValueReq<2>(hertz, 0x40));  
-  for (uint8_t i = 0; i <= TARIFFS; i++)
-    add(new ReadEnergyReq(curDayEnergy[i], E_CUR_DAY, i));
-  for (uint8_t i = 0; i <= TARIFFS; i++)
-    add(new ReadEnergyReq(prevDayEnergy[i], E_PREV_DAY, i));  
+  for (uint8_t m = 0; m < METERS; m++)
+    setupMeter(m);
+  cur_meter = 0;
   reinitLoop();  
 }
 
 void resetAllValues() {
-  Req* req = openChannel.next;
-  while(req != nullptr) {
-    req->error("no channel");  
-    req = req->next;
+  Meter& meter = meters[cur_meter];
+  MeterPoll& poll = polls[cur_meter];
+  ReqDesc desc;
+  for (uint8_t i = R_OPEN + 1; i < REQS; i++) {
+    loadDesc(i, desc);
+    error(meter, poll, i, desc, NO_CHANNEL);
+    poll.reqs[i].valid = false;
+    if (i != R_PROFILE) // due only while there are records to read
+      poll.reqs[i].due.reset(0); // poll again as soon as channel is open
+  }
+}
+
+int8_t countValidValues() {
+  int8_t n = 0;
+  for (uint8_t i = 0; i < REQS; i++) {
+    ReqState& req = polls[cur_meter].reqs[i];
+    if (req.enabled && req.valid) n++;
   }
+  return n;
+}
+
+// skips to the next request in the table that is due for polling
+void nextDueReq() {
+  ReqState* reqs = polls[cur_meter].reqs;
+  do {
+    cur_index++;
+  } while (cur_index < REQS && !(reqs[cur_index].enabled && reqs[cur_index].due.check()));
+  if (cur_index < REQS) {
+    ReqDesc desc;
+    loadDesc(cur_index, desc);
+    reqs[cur_index].due.reset(desc.period / 100 * pollPercent);
+  }
+}
+
+// meters are polled round-robin, one pass at a time
+void nextMeter() {
+  cur_meter++;
+  if (cur_meter >= METERS) cur_meter = 0;
+  reinitLoop();
+}
+
+// finishes pass of the current meter
+bool donePass() {
+#ifdef RS485_SIMULATOR
+  benchPasses++;
+  checkBench();
+#endif
+  Meter& meter = meters[cur_meter];
+  meter.validValues = countValidValues();
+  meter.updateTime = millis() - polls[cur_meter].updateStart;
+  meter.passes++;
+  nextMeter();
+  return true; // done
 }
 
 bool checkNext() {
-  if (lastDisplayEnergyType != displayEnergyType) {
-    // abort & restart on change of displayEnergyType
-    reinitLoop();
+  if (lastDisplayEnergyType != displayEnergyType || lastDisplayMeter != displayMeter) {
+    // display shows cached counters, only those that were not read yet are polled on the next pass
+    ReqState* reqs = polls[displayMeter].reqs + R_ENERGY + displayEnergyType * (TARIFFS + 1);
+    for (uint8_t i = 0; i <= TARIFFS; i++)
+      if (!reqs[i].valid) reqs[i].due.reset(0);
     lastDisplayEnergyType = displayEnergyType;
-    refreshDisplayEnergy = true;
-    return false;
-  }
-  if (refreshDisplayEnergy && cur_req == displayEnergyReq[TARIFFS]) {
-    reinitLoop();
-    refreshDisplayEnergy = false;  
-    return true; // done refreshing
+    lastDisplayMeter = displayMeter;
   }
-  // regular -- work till the end
+  // regular -- work till the end of due requests
   cur_state = 0;
-  cur_req = cur_req->next;
-  if (cur_req != nullptr) return false; // not done yet
-  validValues = ok_values;
-  mercuryUpdateTime = millis() - mercuryUpdateStart;
-  reinitLoop();  
-  return true; // done
+  nextDueReq();
+  if (cur_index < REQS) return false; // not done yet
+  return donePass();
+}
+
+// keeps track of channel session on every response
+void checkChannel(bool success) {
+  MeterPoll& poll = polls[cur_meter];
+  if (success) {
+    poll.channelOpen = true;
+    poll.channelIdle.reset(CHANNEL_IDLE_TIMEOUT);
+    poll.timeouts = 0;
+    return;
+  }
+  if (res_error == ERR_TIMEOUT && ++poll.timeouts >= CHANNEL_TIMEOUTS) {
+    poll.channelOpen = false;
+    poll.timeouts = 0;
+  }
+  if (res_error == ERR_ACCESS || res_error == ERR_CHANNEL)
+    poll.channelOpen = false;
+}
+
+// failed request is polled again soon instead of after its refresh period, backing off on repeated failures
+void retryReq(ReqState& req) {
+  unsigned long period = cur_desc.period / 100 * pollPercent;
+  unsigned long delay = RETRY_DELAY << (req.retries < RETRY_MAX_SHIFT ? req.retries : RETRY_MAX_SHIFT);
+  req.due.reset(delay < period ? delay : period);
+  if (req.retries < 0xff) req.retries++;
 }
 
 bool checkMercury() {
-  cur_state = cur_req->check(cur_state);
+  if (cur_index >= REQS) return donePass(); // nothing was due
+  ReqState& req = polls[cur_meter].reqs[cur_index];
+  if (cur_state == 0) bus_start = millis();
+  cur_state = checkReq(cur_state);
+  if (cur_state < 0) {
+    bus_time += millis() - bus_start;
+    countStats(reqStats[cur_index], cur_state == S_SUCCESS);
+    countStats(meterStats[cur_meter], cur_state == S_SUCCESS);
+    checkBaud(cur_state == S_SUCCESS);
+  }
+#ifdef RS485_SIMULATOR
+  if (cur_state < 0) benchRequests++;
+#endif
   switch(cur_state) {
     case S_ERROR:
-      if (cur_req == &openChannel) { 
-        // open channel error - retry from scratch
+      req.valid = false;
+      checkChannel(false);
+      if (cur_index == R_OPEN) { 
+        // open channel error - retry this meter on its next turn
+        Meter& meter = meters[cur_meter];
         resetAllValues();
-        reinitLoop();
-        bool wasOk = validValues > 0;
-        validValues = 0;
+        bool wasOk = meter.validValues > 0;
+        meter.validValues = 0;
+        nextMeter();
         return wasOk;
+      }
+      retryReq(req);
+      if (!polls[cur_meter].channelOpen) {
+        // channel was lost - reopen it on this meter's next turn
+        return donePass();
       } else {
-        // just a value error - skip it
+        // just a value error - skip it till retry
         return checkNext();
       }
     case S_SUCCESS:
-      ok_values++;
+      req.valid = true;
+      req.retries = 0;
+      checkChannel(true);
       return checkNext();
   }
   return false;
 }
+
+void printMercuryStats(Print& out) {
+  out.print("bus,");
+  out.print(RS485_BAUDS[baud_index]);
+  out.print(',');
+  out.print(bus_time * 100.0 / millis()); // utilization, %
+  out.println();
+  for (uint8_t i = 0; i < baud_history_size; i++) {
+    BaudSwitch& sw = baud_history[i];
+    out.print("baud,");
+    out.print((millis() - sw.time) / 1000); // seconds ago
+    out.print(',');
+    out.print(sw.baud);
+    out.print(',');
+    out.println(sw.reason);
+  }
+  out.println("meter,request,ok,timeout,crc,bad,min,avg,max,<20,<50,<100,<200,>=200");
+  // '*' -- all meters or all requests
+  for (uint8_t m = 0; m < METERS; m++) {
+    out.print(m + 1);
+    out.print(",*,");
+    printStats(out, meterStats[m]);
+  }
+  for (uint8_t i = 0; i < REQS; i++) {
+    out.print("*,");
+    printReqName(out, i);
+    out.print(',');
+    printStats(out, reqStats[i]);
+  }
+}
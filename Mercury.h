@@ -13,28 +13,56 @@ struct MercuryTime {
   uint8_t year;
 };
 
-extern MercuryTime mercuryTime;
-
 enum EnergyType { E_TOTAL, E_CUR_DAY, E_PREV_DAY, E_CUR_MONTH, E_PREV_MONTH, E_PR_2_MONTH, E_CUR_YEAR, E_PREV_YEAR };
 
-extern EnergyType displayEnergyType;
+const uint8_t ENERGY_TYPES = 8;
 
 const int8_t TARIFFS = 2;
 
-extern fixnum32_1 volts[4];
-extern fixnum32_1 amps[4];
-extern fixnum32_1 watts[4];
-extern fixnum32_1 hertz;
-extern fixnum32_3 displayEnergy[TARIFFS + 1];
-extern fixnum32_3 curDayEnergy[TARIFFS + 1];
-extern fixnum32_3 prevDayEnergy[TARIFFS + 1];
+// mantissa of values that were not read
+const int32_t INVALID_VALUE = 0x7fffffffL;
+
+// number of stored power profile records that are kept until pushed
+const uint8_t PROFILE_SIZE = 16;
+
+// average power over a profile period that ends at the given time
+struct ProfileRecord {
+  MercuryTime time;
+  fixnum32_1 watts;
+};
+
+// number of meters on RS485 bus, their addresses are configured in Mercury.cpp
+const uint8_t METERS = 1;
+
+struct Meter {
+  uint8_t addr;
+  MercuryTime time;
+  fixnum32_1 volts[4];
+  fixnum32_1 amps[4];
+  fixnum32_1 watts[4];
+  fixnum32_1 hertz;
+  fixnum32_3 energy[ENERGY_TYPES][TARIFFS + 1]; // cached energy counters, refreshed in background
+  ProfileRecord profile[PROFILE_SIZE]; // read from meter memory, but not pushed yet
+  uint8_t profileCount;
+  int8_t validValues;
+  int8_t expectedValues;
+  long updateTime;
+  long passes; // completed passes
+};
 
-extern int8_t validValues;
-extern int8_t expectedValues;
+extern Meter meters[METERS];
+
+// meter and energy type that are shown on display, their counters are read first if not cached yet
+extern uint8_t displayMeter;
+extern EnergyType displayEnergyType;
 
-extern long mercuryUpdateTime;
+// refresh periods of requests in percent of the ones in REQ_TABLE, changed remotely
+const uint16_t MIN_POLL_PERCENT = 1;
+const uint16_t MAX_POLL_PERCENT = 1000;
+extern uint16_t pollPercent;
 
 void setupMercury();
 bool checkMercury();
+void printMercuryStats(Print& out); // per-meter & per-request RS485 statistics in CSV
 
 #endif
@@ -0,0 +1,202 @@
+#include <avr/pgmspace.h>
+
+#include "MercurySim.h"
+#include "crc.h"
+
+MercurySimClass mercurySim;
+
+//------- TRACE ------
+
+// Recorded frames that are replayed on matching requests, address and CRC are not included.
+// Each entry: request length, request bytes, response length, response bytes; zero request length ends it.
+// Entries that match the same request are replayed in turn, requests not found here are answered
+// from simulated values below. Host bench loads captured traces instead, see test/mercury_bench.cpp
+const uint8_t SIM_TRACE[] PROGMEM = {
+  2, 0x04, 0x00, // read time
+  8, 0x00, 0x30, 0x12, 0x05, 0x17, 0x10, 0x26, 0x00, // 12:30:00 Fri 17.10.26
+  0
+};
+
+//------- SIMULATED VALUES ------
+
+const int32_t SIM_VOLTS = 23000; // 230.00 V
+const int32_t SIM_AMPS = 1500; // 1.500 A
+const int32_t SIM_WATTS = 34500; // 345.00 W
+const int32_t SIM_HERTZ = 5000; // 50.00 Hz
+const int32_t SIM_ENERGY = 1234567; // 1234.567 kWh
+const uint16_t SIM_PROFILE_LAST = 0x1f40; // address of the last power profile record
+const uint16_t SIM_PROFILE_PULSES = 345; // 345 W over 30 min with A = 1000 imp/kWh
+
+//------- IMPLEMENTATION ------
+
+void MercurySimClass::begin(long baud) {
+  _char_time = 11000000L / baud; // start, 8 data, parity & stop bits
+}
+
+int MercurySimClass::available() {
+  if (_req_size > 0) endRequest();
+  if (_res_read >= _res_size) return 0;
+  unsigned long t = micros() - _res_time;
+  if ((long)t < 0) return 0;
+  unsigned long n = t / _char_time + 1;
+  if (n > _res_size) n = _res_size;
+  return n > _res_read ? n - _res_read : 0;
+}
+
+int MercurySimClass::read() {
+  if (available() == 0) return -1;
+  return _res[_res_read++];
+}
+
+// request bytes are collected till master stops writing and waits for response
+size_t MercurySimClass::write(uint8_t b) {
+  if (_req_size == 0) {
+    _req_crc[0] = 0xff;
+    _req_crc[1] = 0xff;
+  }
+  if (_req_size == sizeof(_req)) return 1; // garbage, dropped at the end of request
+  _req[_req_size++] = b;
+  updateCRC(_req_crc, b);
+  return 1;
+}
+
+// meter ends frame by silence on the line, CRC alone cannot end it: the high byte of CRC may be 0
+void MercurySimClass::endRequest() {
+  if (_req_size >= 4 && _req_crc[0] == 0 && _req_crc[1] == 0)
+    frame(_req_size);
+  _req_size = 0;
+}
+
+void MercurySimClass::frame(uint8_t size) {
+  _res_size = 0;
+  _res_read = 0;
+  if (_req[1] == 0x01) _channelOpen = true; // replayed open channel response opens it, too
+  uint8_t n = trace(size) ? _res_size : respond(size);
+  _res[0] = _req[0];
+  computeCRC(_res, n);
+  if (random(10000) < config.crcRate) _res[n] ^= 0x01;
+  _res_size = n + 2;
+  // drop bytes from the response
+  for (uint8_t i = 0; i < _res_size; i++)
+    if (random(10000) < config.dropRate) {
+      memmove(_res + i, _res + i + 1, _res_size - i - 1);
+      _res_size--;
+    }
+  // response starts after the request is transmitted
+  _res_time = micros() + _char_time + (config.latency + random(config.jitter + 1)) * 1000L;
+}
+
+void MercurySimClass::setTrace(const uint8_t* trace) {
+  _trace = trace;
+  _trace_next = 0;
+}
+
+// search starts after the last replayed entry and wraps around once
+bool MercurySimClass::trace(uint8_t size) {
+  uint8_t n = size - 3;
+  const uint8_t* start = _trace != nullptr ? _trace : SIM_TRACE;
+  const uint8_t* p = start + _trace_next;
+  uint8_t wraps = 0;
+  while (wraps < 2) {
+    uint8_t req_len = pgm_read_byte(p++);
+    if (req_len == 0) {
+      p = start;
+      wraps++;
+      continue;
+    }
+    bool match = req_len == n;
+    for (uint8_t i = 0; i < req_len; i++)
+      if (pgm_read_byte(p++) != _req[1 + i]) match = false;
+    uint8_t res_len = pgm_read_byte(p++);
+    if (match && res_len <= sizeof(_res) - 3) {
+      for (uint8_t i = 0; i < res_len; i++)
+        _res[1 + i] = pgm_read_byte(p + i);
+      _res_size = 1 + res_len;
+      _trace_next = p + res_len - start;
+      return true;
+    }
+    p += res_len;
+  }
+  return false;
+}
+
+uint8_t MercurySimClass::error(uint8_t code) {
+  _res[1] = code;
+  return 2;
+}
+
+// puts 3-byte value at i-th position of response
+uint8_t MercurySimClass::value(uint8_t i, int32_t v) {
+  uint8_t* b = _res + 1 + 3 * i;
+  b[0] = (v >> 16) & 0x3f;
+  b[1] = v;
+  b[2] = v >> 8;
+  return 1 + 3 * (i + 1);
+}
+
+// 30-min power profile records that end at 00:30, 01:00, ... for each 16-byte slot of memory
+uint8_t MercurySimClass::profile(uint16_t addr, uint8_t bytes) {
+  if (bytes > sizeof(_res) - 3) return error(0x01);
+  for (uint8_t i = 0; i < bytes; i++) {
+    uint16_t slot = (addr + i) / 16;
+    uint8_t r[16] = { 0, 0, 0, 0x17, 0x10, 0x26, 30, SIM_PROFILE_PULSES & 0xff, SIM_PROFILE_PULSES >> 8 };
+    uint8_t end = (slot + 1) % 48; // half-hours since midnight
+    r[1] = (end / 2 / 10) << 4 | (end / 2 % 10); // BCD hour
+    r[2] = end % 2 == 0 ? 0x00 : 0x30; // BCD minute
+    _res[1 + i] = r[(addr + i) % 16];
+  }
+  return 1 + bytes;
+}
+
+uint8_t MercurySimClass::respond(uint8_t size) {
+  switch (_req[1]) {
+  case 0x01: // open channel
+    return error(0x00);
+  case 0x04: // read time
+    return error(0x01); // not in trace
+  case 0x05: { // read summaries
+    if (!_channelOpen) return error(0x05);
+    int32_t v = SIM_ENERGY;
+    _res[1] = v >> 16;
+    _res[2] = v >> 24;
+    _res[3] = v;
+    _res[4] = v >> 8;
+    memset(_res + 5, 0, 12); // A-, R+, R-
+    return 17;
+  }
+  case 0x06: // read memory
+    if (!_channelOpen) return error(0x05);
+    if (_req[2] == 0x03) return profile(((uint16_t)_req[3] << 8) | _req[4], _req[5]);
+    return error(0x01);
+  case 0x08: // read params
+    if (!_channelOpen) return error(0x05);
+    if (_req[2] == 0x13) {
+      memset(_res + 1, 0, 9);
+      _res[1] = SIM_PROFILE_LAST >> 8;
+      _res[2] = SIM_PROFILE_LAST & 0xff;
+      return 10;
+    }
+    if (_req[2] == 0x11) {
+      uint8_t code = _req[3];
+      if (code <= 0x03) return value(0, code == 0 ? 3 * SIM_WATTS : SIM_WATTS);
+      if (code >= 0x11 && code <= 0x13) return value(0, SIM_VOLTS);
+      if (code >= 0x21 && code <= 0x23) return value(0, SIM_AMPS);
+      if (code == 0x40) return value(0, SIM_HERTZ);
+    } else if (_req[2] == 0x16 && config.grouped) {
+      switch (_req[3]) {
+      case 0x00:
+        value(0, 3 * SIM_WATTS);
+        for (uint8_t i = 1; i <= 3; i++) value(i, SIM_WATTS);
+        return 13;
+      case 0x11:
+        for (uint8_t i = 0; i < 3; i++) value(i, SIM_VOLTS);
+        return 10;
+      case 0x21:
+        for (uint8_t i = 0; i < 3; i++) value(i, SIM_AMPS);
+        return 10;
+      }
+    }
+    return error(0x01);
+  }
+  return error(0x01);
+}
@@ -0,0 +1,51 @@
+#ifndef MERCURY_SIM_H_
+#define MERCURY_SIM_H_
+
+#include <Arduino.h>
+
+// Simulated Mercury 230 meter that stands in for the RS485 line,
+// see RS485_SIMULATOR in Mercury.cpp
+
+struct MercurySimConfig {
+  uint16_t latency;   // response latency, ms
+  uint16_t jitter;    // random extra latency, ms
+  uint16_t dropRate;  // dropped bytes per 10000 bytes
+  uint16_t crcRate;   // corrupted CRCs per 10000 frames
+  bool grouped;       // grouped multi-phase reads are supported
+};
+
+class MercurySimClass {
+private:
+  uint8_t _req[20];
+  uint8_t _req_size;
+  uint8_t _req_crc[2];
+  uint8_t _res[72]; // fits profile readout of 4 records
+  uint8_t _res_size;
+  uint8_t _res_read;
+  unsigned long _res_time; // time when the first response byte arrives
+  unsigned long _char_time; // time to transmit one byte, us
+  bool _channelOpen;
+  const uint8_t* _trace = nullptr; // nullptr -- SIM_TRACE
+  size_t _trace_next; // offset of the entry after the last replayed one
+
+  void endRequest();
+  bool trace(uint8_t size);
+  void frame(uint8_t size);
+  uint8_t respond(uint8_t size);
+  uint8_t error(uint8_t code);
+  uint8_t value(uint8_t i, int32_t v);
+  uint8_t profile(uint16_t addr, uint8_t bytes);
+public:
+  MercurySimConfig config = { 10, 10, 0, 0, true };
+  void setTrace(const uint8_t* trace); // recorded frames in SIM_TRACE encoding, nullptr -- built-in ones
+  void begin(long baud);
+  void end() {}
+  int available();
+  int read();
+  int availableForWrite() { return sizeof(_req); }
+  size_t write(uint8_t b);
+};
+
+extern MercurySimClass mercurySim;
+
+#endif
@@ -0,0 +1,153 @@
+#include <Timeout.h>
+#include <math.h>
+
+#include "aggregate.h"
+
+const unsigned long AGG_WINDOW = 300000L; // 5min
+
+MeterAgg meterAggs[METERS];
+unsigned long aggWindow = AGG_WINDOW;
+Timeout aggTimeout;
+
+//------- Aggregate ------
+
+void Aggregate::reset() {
+  n = 0;
+  mean = 0;
+  m2 = 0;
+}
+
+void Aggregate::add(int32_t v) {
+  if (n == 0xffff) return;
+  if (n == 0 || v < min) min = v;
+  if (n == 0 || v > max) max = v;
+  n++;
+  // Welford's algorithm
+  float d = v - mean;
+  mean += d / n;
+  m2 += d * (v - mean);
+}
+
+int32_t Aggregate::meanValue() {
+  return n == 0 ? INVALID_VALUE : lround(mean);
+}
+
+int32_t Aggregate::stdDev() {
+  return n == 0 ? INVALID_VALUE : lround(sqrt(m2 / n));
+}
+
+//------- AggValue ------
+
+void AggValue::add(int32_t v) {
+  if (v != INVALID_VALUE) cur.add(v);
+}
+
+void AggValue::roll() {
+  last = cur;
+  cur.reset();
+}
+
+//------- METER AGGREGATES ------
+
+void updateMeter(Meter& meter, MeterAgg& agg) {
+  for (uint8_t i = 0; i <= 3; i++)
+    agg.watts[i].add(meter.watts[i].mantissa());
+  agg.hertz.add(meter.hertz.mantissa());
+  int32_t sum = 0;
+  int32_t dev = 0;
+  bool valid = true;
+  for (uint8_t i = 1; i <= 3; i++) {
+    int32_t v = meter.volts[i].mantissa();
+    int32_t a = meter.amps[i].mantissa();
+    agg.volts[i].add(v);
+    agg.amps[i].add(a);
+    if (v == INVALID_VALUE || a == INVALID_VALUE) {
+      valid = false;
+      continue;
+    }
+    agg.apparent[i].add(v * a / 10); // 0.1V * 0.1A
+    sum += a;
+  }
+  if (!valid || sum == 0) return;
+  for (uint8_t i = 1; i <= 3; i++) {
+    int32_t d = abs(3 * meter.amps[i].mantissa() - sum);
+    if (d > dev) dev = d;
+  }
+  agg.imbalance.add(dev * 1000 / sum); // 0.1%
+}
+
+void rollMeter(MeterAgg& agg) {
+  for (uint8_t i = 0; i <= 3; i++) {
+    agg.volts[i].roll();
+    agg.amps[i].roll();
+    agg.watts[i].roll();
+    agg.apparent[i].roll();
+  }
+  agg.hertz.roll();
+  agg.imbalance.roll();
+}
+
+void setupAggregates() {
+  for (uint8_t m = 0; m < METERS; m++)
+    rollMeter(meterAggs[m]);
+  aggTimeout.reset(aggWindow);
+}
+
+// current window is restarted with the new length, values collected so far are kept
+void setAggWindow(unsigned long window) {
+  aggWindow = window;
+  aggTimeout.reset(aggWindow);
+}
+
+// aggregates values of all meters that have completed a pass
+bool checkAggregates() {
+  for (uint8_t m = 0; m < METERS; m++) {
+    MeterAgg& agg = meterAggs[m];
+    if (agg.passes == meters[m].passes) continue;
+    agg.passes = meters[m].passes;
+    updateMeter(meters[m], agg);
+  }
+  if (!aggTimeout.check()) return false;
+  aggTimeout.reset(aggWindow);
+  for (uint8_t m = 0; m < METERS; m++)
+    rollMeter(meterAggs[m]);
+  return true;
+}
+
+//------- OUTPUT ------
+
+void printAggregate(Print& out, uint8_t m, const char* name, uint8_t i, AggValue& value, prec_t prec) {
+  Aggregate& a = value.last;
+  char buf[12];
+  out.print(m + 1);
+  out.print(',');
+  out.print(name);
+  if (i > 0) out.print(i);
+  out.print(',');
+  out.print(a.n);
+  int32_t vals[4] = { a.n > 0 ? a.min : INVALID_VALUE, a.n > 0 ? a.max : INVALID_VALUE, a.meanValue(), a.stdDev() };
+  for (uint8_t k = 0; k < 4; k++) {
+    out.print(',');
+    if (vals[k] == INVALID_VALUE) continue;
+    buf[formatDecimal(vals[k], buf, 11, prec)] = 0;
+    out.print(buf);
+  }
+  out.println();
+}
+
+// CSV of the last complete window
+void printAggregates(Print& out) {
+  out.println("meter,value,n,min,max,mean,stddev");
+  for (uint8_t m = 0; m < METERS; m++) {
+    MeterAgg& agg = meterAggs[m];
+    printAggregate(out, m, "W", 0, agg.watts[0], 1);
+    for (uint8_t i = 1; i <= 3; i++) {
+      printAggregate(out, m, "V", i, agg.volts[i], 1);
+      printAggregate(out, m, "A", i, agg.amps[i], 1);
+      printAggregate(out, m, "W", i, agg.watts[i], 1);
+      printAggregate(out, m, "VA", i, agg.apparent[i], 1);
+    }
+    printAggregate(out, m, "Hz", 0, agg.hertz, 1);
+    printAggregate(out, m, "imbalance%", 0, agg.imbalance, 1);
+  }
+}
@@ -0,0 +1,51 @@
+#ifndef AGGREGATE_H_
+#define AGGREGATE_H_
+
+#include <Arduino.h>
+#include <FixNum.h>
+
+#include "Mercury.h"
+
+// running min/max/mean/variance of a value
+struct Aggregate {
+  uint16_t n;
+  int32_t min;
+  int32_t max;
+  float mean;
+  float m2; // sum of squared deviations from mean
+
+  void reset();
+  void add(int32_t v);
+  int32_t meanValue(); // rounded mean
+  int32_t stdDev();
+};
+
+// aggregate of a value over the current and the last complete window
+struct AggValue {
+  Aggregate cur;
+  Aggregate last;
+
+  void add(int32_t v);
+  void roll();
+};
+
+// aggregates of all meter values, phases are 1..3, index 0 is total for watts only
+struct MeterAgg {
+  AggValue volts[4];
+  AggValue amps[4];
+  AggValue watts[4];
+  AggValue hertz;
+  AggValue apparent[4]; // apparent power of each phase, VA
+  AggValue imbalance;   // max deviation of phase current from average, %
+  long passes;          // last aggregated pass
+};
+
+extern MeterAgg meterAggs[METERS];
+extern unsigned long aggWindow; // ms, changed remotely
+
+void setupAggregates();
+bool checkAggregates(); // true when window is complete
+void setAggWindow(unsigned long window);
+void printAggregates(Print& out);
+
+#endif
@@ -1,6 +1,13 @@
 #include "crc.h"
 #include <avr/pgmspace.h>
 
+// CRC-16/MODBUS: reflected polynomial 0xA001, initial value 0xffff, low byte is sent first
+
+//------- TABLE KERNEL ------
+
+#if CRC_KERNEL == CRC_TABLE || defined(CRC_BENCHMARK)
+
+// low and high bytes of CRC of each byte value
 const uint8_t srCRCHi[256] PROGMEM = {
 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41,
 0x00, 0xC1, 0x81, 0x40, 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81, 0x40,
@@ -29,15 +36,114 @@ const uint8_t srCRCLo[256] PROGMEM = {
 0x77, 0xB7, 0xB6, 0x76, 0x72, 0xB2, 0xB3, 0x73, 0xB1, 0x71, 0x70, 0xB0, 0x50, 0x90, 0x91, 0x51, 0x93, 0x53, 0x52, 0x92,
 0x96, 0x56, 0x57, 0x97, 0x55, 0x95, 0x94, 0x54, 0x9C, 0x5C, 0x5D, 0x9D, 0x5F, 0x9F, 0x9E, 0x5E, 0x5A, 0x9A, 0x9B, 0x5B,
 0x99, 0x59, 0x58, 0x98, 0x88, 0x48, 0x49, 0x89, 0x4B, 0x8B, 0x8A, 0x4A, 0x4E, 0x8E, 0x8F, 0x4F, 0x8D, 0x4D, 0x4C, 0x8C,
-0x44, 0x84, 0x85, 0x45, 0x87, 0x47, 0x46, 0x86, 0x82, 0x42, 0x43, 0x83, 0x41, 0x81, 0x80, 0x40}; 
+0x44, 0x84, 0x85, 0x45, 0x87, 0x47, 0x46, 0x86, 0x82, 0x42, 0x43, 0x83, 0x41, 0x81, 0x80, 0x40};
+
+inline uint16_t crcTable(uint16_t crc, uint8_t c) {
+  uint8_t j = crc ^ c;
+  return ((crc >> 8) ^ pgm_read_byte(srCRCHi + j)) | ((uint16_t)pgm_read_byte(srCRCLo + j) << 8);
+}
+
+#endif
+
+//------- NIBBLE KERNEL ------
+
+#if CRC_KERNEL == CRC_NIBBLE || defined(CRC_BENCHMARK)
+
+// CRC of each 4-bit value
+const uint16_t srCRCNibble[16] PROGMEM = {
+0x0000, 0xCC01, 0xD801, 0x1400, 0xF001, 0x3C00, 0x2800, 0xE401,
+0xA001, 0x6C00, 0x7800, 0xB401, 0x5000, 0x9C01, 0x8801, 0x4400};
+
+inline uint16_t crcNibble(uint16_t crc, uint8_t c) {
+  crc ^= c;
+  crc = (crc >> 4) ^ pgm_read_word(srCRCNibble + (crc & 0x0f));
+  return (crc >> 4) ^ pgm_read_word(srCRCNibble + (crc & 0x0f));
+}
+
+#endif
+
+//------- BITWISE KERNEL ------
+
+inline uint16_t crcBitwise(uint16_t crc, uint8_t c) {
+  crc ^= c;
+  for (uint8_t i = 0; i < 8; i++)
+    crc = (crc & 1) ? (crc >> 1) ^ 0xA001 : crc >> 1;
+  return crc;
+}
+
+//------- API ------
+
+#if CRC_KERNEL == CRC_TABLE
+#define crcStep crcTable
+#elif CRC_KERNEL == CRC_NIBBLE
+#define crcStep crcNibble
+#else
+#define crcStep crcBitwise
+#endif
 
 void computeCRC(byte* a, uint8_t len) {
-  a[len + 0] = 0xff;
-  a[len + 1] = 0xff;
-  for (uint8_t i = 0; i < len; i++) {
-    uint8_t c = a[i];
-    uint8_t j = a[len + 0] ^ c;
-    a[len + 0] = a[len + 1] ^ pgm_read_byte(srCRCHi + j);
-    a[len + 1] = pgm_read_byte(srCRCLo + j);
-  } 
+  uint16_t crc = 0xffff;
+  for (uint8_t i = 0; i < len; i++)
+    crc = crcStep(crc, a[i]);
+  a[len + 0] = crc;
+  a[len + 1] = crc >> 8;
+}
+
+bool checkCRC(const byte* a, uint8_t len) {
+  uint16_t crc = 0xffff;
+  for (uint8_t i = 0; i < len; i++)
+    crc = crcStep(crc, a[i]);
+  return crc == 0;
 }
+
+void updateCRC(byte* crc, uint8_t c) {
+  uint16_t v = crcStep(crc[0] | ((uint16_t)crc[1] << 8), c);
+  crc[0] = v;
+  crc[1] = v >> 8;
+}
+
+//------- BENCHMARK ------
+
+#ifdef CRC_BENCHMARK
+
+const uint16_t CRC_BENCH_SIZE = 64; // bytes in a frame
+const uint16_t CRC_BENCH_FRAMES = 1000;
+
+typedef uint16_t (*CRCKernel)(uint16_t crc, uint8_t c);
+
+void benchKernel(Print& out, const char* name, CRCKernel kernel, uint16_t flash, uint16_t expected) {
+  byte a[CRC_BENCH_SIZE];
+  for (uint16_t i = 0; i < CRC_BENCH_SIZE; i++)
+    a[i] = i * 7 + 3;
+  uint16_t crc = 0xffff;
+  unsigned long start = micros();
+  for (uint16_t k = 0; k < CRC_BENCH_FRAMES; k++) {
+    crc = 0xffff;
+    for (uint16_t i = 0; i < CRC_BENCH_SIZE; i++)
+      crc = kernel(crc, a[i]);
+  }
+  unsigned long time = micros() - start;
+  out.print(name);
+  out.print(',');
+  out.print(flash);
+  out.print(',');
+  out.print((float)CRC_BENCH_SIZE * CRC_BENCH_FRAMES * 1000 / time);
+  out.print(',');
+  out.println(crc == expected ? "ok" : "mismatch");
+}
+
+void benchCRC(Print& out) {
+  byte a[CRC_BENCH_SIZE + 2];
+  for (uint16_t i = 0; i < CRC_BENCH_SIZE; i++)
+    a[i] = i * 7 + 3;
+  computeCRC(a, CRC_BENCH_SIZE);
+  uint16_t expected = a[CRC_BENCH_SIZE] | ((uint16_t)a[CRC_BENCH_SIZE + 1] << 8);
+  out.print("selected kernel: ");
+  out.println(checkCRC(a, CRC_BENCH_SIZE + 2) ? "ok" : "failed");
+  out.println("kernel,table bytes,bytes/ms,result");
+  benchKernel(out, "table", &crcTable, sizeof(srCRCHi) + sizeof(srCRCLo), expected);
+  benchKernel(out, "nibble", &crcNibble, sizeof(srCRCNibble), expected);
+  benchKernel(out, "bitwise", &crcBitwise, 0, expected);
+}
+
+#endif
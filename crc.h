@@ -3,6 +3,29 @@
 
 #include <Arduino.h>
 
+// CRC kernels: table is the fastest, nibble and bitwise trade speed for flash
+#define CRC_TABLE 0   // two 256-byte tables
+#define CRC_NIBBLE 1  // 16-entry table of 16-bit words
+#define CRC_BITWISE 2 // no table
+
+#ifndef CRC_KERNEL
+#define CRC_KERNEL CRC_TABLE
+#endif
+
+// #define CRC_BENCHMARK // serve throughput of all kernels at /crc, test/crc_test.cpp checks them on host
+
+// puts CRC of len bytes after them
 extern void computeCRC(byte* a, uint8_t len);
 
+// checks CRC of a frame of len bytes that ends with its CRC, frame is not changed
+extern bool checkCRC(const byte* a, uint8_t len);
+
+// updates CRC of a frame that is received byte by byte, crc starts as { 0xff, 0xff }
+// and is { 0, 0 } after the whole frame with its correct CRC
+extern void updateCRC(byte* crc, uint8_t c);
+
+#ifdef CRC_BENCHMARK
+extern void benchCRC(Print& out); // CSV of kernel, table size, throughput & result
+#endif
+
 #endif // CRC_H_
@@ -0,0 +1,137 @@
+#include <avr/pgmspace.h>
+
+#include "deflate.h"
+
+const uint8_t MIN_MATCH = 3;
+const uint16_t MAX_DIST = DEFLATE_WINDOW - DEFLATE_MAX_MATCH; // history that is not overwritten by lookahead
+const uint16_t HASH_SIZE = 1 << DEFLATE_HASH_BITS;
+const uint16_t END_OF_BLOCK = 256;
+const uint32_t ADLER_MOD = 65521;
+
+static_assert((DEFLATE_WINDOW & (DEFLATE_WINDOW - 1)) == 0, "DEFLATE_WINDOW is power of two");
+static_assert(DEFLATE_MAX_MATCH <= 258, "deflate codes matches up to 258 bytes");
+
+// length codes 257..285: base length and extra bits
+const uint16_t LENGTH_BASE[29] PROGMEM = {
+  3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+const uint8_t LENGTH_EXTRA[29] PROGMEM = {
+  0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+
+// distance codes 0..29: base distance and extra bits
+const uint16_t DIST_BASE[30] PROGMEM = {
+  1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769,
+  1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+const uint8_t DIST_EXTRA[30] PROGMEM = {
+  0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+DeflatePrint::DeflatePrint(Print& out) : _out(out) {
+  memset(_head, 0, sizeof(_head));
+  _pos = 0;
+  _pending = 0;
+  _bits = 0;
+  _bitCount = 0;
+  _adlerA = 1;
+  _adlerB = 0;
+  _out.write((uint8_t)0x78); // zlib header: deflate, 32K window
+  _out.write((uint8_t)0x01); // no dictionary, fastest compression, header is multiple of 31
+  putBits(1, 1); // the only block is the last one
+  putBits(1, 2); // fixed Huffman codes
+}
+
+uint16_t DeflatePrint::hash(uint32_t pos) {
+  return (at(pos) * 961 + at(pos + 1) * 31 + at(pos + 2)) & (HASH_SIZE - 1);
+}
+
+// bits are packed starting from the least significant one
+void DeflatePrint::putBits(uint32_t bits, uint8_t n) {
+  _bits |= bits << _bitCount;
+  _bitCount += n;
+  while (_bitCount >= 8) {
+    _out.write((uint8_t)_bits);
+    _bits >>= 8;
+    _bitCount -= 8;
+  }
+}
+
+// Huffman codes are packed starting from the most significant bit
+void DeflatePrint::putCode(uint16_t code, uint8_t n) {
+  uint16_t r = 0;
+  for (uint8_t i = 0; i < n; i++) {
+    r = (r << 1) | (code & 1);
+    code >>= 1;
+  }
+  putBits(r, n);
+}
+
+// fixed literal/length code
+void DeflatePrint::putSymbol(uint16_t sym) {
+  if (sym < 144)
+    putCode(0x30 + sym, 8);
+  else if (sym < 256)
+    putCode(0x190 + sym - 144, 9);
+  else if (sym < 280)
+    putCode(sym - 256, 7);
+  else
+    putCode(0xc0 + sym - 280, 8);
+}
+
+void DeflatePrint::putMatch(uint16_t len, uint16_t dist) {
+  uint8_t i = 28;
+  while (pgm_read_word(&LENGTH_BASE[i]) > len)
+    i--;
+  putSymbol(257 + i);
+  putBits(len - pgm_read_word(&LENGTH_BASE[i]), pgm_read_byte(&LENGTH_EXTRA[i]));
+  uint8_t j = 29;
+  while (pgm_read_word(&DIST_BASE[j]) > dist)
+    j--;
+  putCode(j, 5);
+  putBits(dist - pgm_read_word(&DIST_BASE[j]), pgm_read_byte(&DIST_EXTRA[j]));
+}
+
+// encodes the longest match at _pos with the last occurrence of its first 3 bytes, or a literal
+void DeflatePrint::encode() {
+  uint16_t len = 0;
+  uint16_t dist = 0;
+  if (_pending >= MIN_MATCH) {
+    uint16_t h = hash(_pos);
+    uint16_t cand = _head[h];
+    _head[h] = (uint16_t)(_pos + 1);
+    dist = (uint16_t)(_pos - (cand - 1));
+    if (cand != 0 && dist > 0 && dist <= MAX_DIST && dist <= _pos)
+      while (len < _pending && at(_pos - dist + len) == at(_pos + len))
+        len++;
+  }
+  if (len < MIN_MATCH) {
+    putSymbol(at(_pos));
+    _pos++;
+    _pending--;
+    return;
+  }
+  putMatch(len, dist);
+  // positions inside match are remembered, too
+  for (uint16_t i = 1; i < len && i + MIN_MATCH <= _pending; i++)
+    _head[hash(_pos + i)] = (uint16_t)(_pos + i + 1);
+  _pos += len;
+  _pending -= len;
+}
+
+size_t DeflatePrint::write(uint8_t c) {
+  _buf[(_pos + _pending) % DEFLATE_WINDOW] = c;
+  _pending++;
+  _adlerA = (_adlerA + c) % ADLER_MOD;
+  _adlerB = (_adlerB + _adlerA) % ADLER_MOD;
+  if (_pending == DEFLATE_MAX_MATCH)
+    encode();
+  return 1;
+}
+
+void DeflatePrint::finish() {
+  while (_pending > 0)
+    encode();
+  putSymbol(END_OF_BLOCK);
+  putBits(0, (8 - _bitCount) % 8);
+  // Adler-32 of uncompressed data, most significant byte first
+  uint32_t adler = (_adlerB << 16) | _adlerA;
+  for (int8_t shift = 24; shift >= 0; shift -= 8)
+    _out.write((uint8_t)(adler >> shift));
+}
@@ -0,0 +1,41 @@
+#ifndef DEFLATE_H_
+#define DEFLATE_H_
+
+#include <Arduino.h>
+
+// Compresses everything that is printed into zlib stream (Content-Encoding: deflate).
+// Matches are searched in a small window with one candidate per hash and are coded
+// with fixed Huffman codes, so there are no tables to build and send.
+
+const uint16_t DEFLATE_WINDOW = 512; // history & lookahead, power of two
+const uint8_t DEFLATE_MAX_MATCH = 64; // lookahead
+const uint8_t DEFLATE_HASH_BITS = 7;
+// stream of n bytes takes at most n * 9 / 8 + DEFLATE_OVERHEAD: no code is longer than 9 bits per byte,
+// plus zlib header, block header, end of block, padding & Adler-32
+const uint8_t DEFLATE_OVERHEAD = 9;
+
+class DeflatePrint : public Print {
+private:
+  Print& _out;
+  uint8_t _buf[DEFLATE_WINDOW];
+  uint16_t _head[1 << DEFLATE_HASH_BITS]; // last position + 1 of each hash of 3 bytes, 0 -- none
+  uint32_t _pos; // bytes that were encoded
+  uint8_t _pending; // bytes after _pos that were written, but not encoded yet
+  uint32_t _bits;
+  uint8_t _bitCount;
+  uint32_t _adlerA;
+  uint32_t _adlerB;
+  uint8_t at(uint32_t pos) { return _buf[pos % DEFLATE_WINDOW]; }
+  uint16_t hash(uint32_t pos);
+  void putBits(uint32_t bits, uint8_t n);
+  void putCode(uint16_t code, uint8_t n);
+  void putSymbol(uint16_t sym);
+  void putMatch(uint16_t len, uint16_t dist);
+  void encode();
+public:
+  DeflatePrint(Print& out);
+  virtual size_t write(uint8_t c);
+  void finish(); // writes the rest of stream, nothing can be written after it
+};
+
+#endif
@@ -0,0 +1,222 @@
+#include <Arduino.h>
+#include <Ethernet2.h>
+#include <EthernetUdp2.h>
+#include <Timeout.h>
+
+#include "dns.h"
+
+#define log SerialUSB
+
+const uint16_t DNS_PORT = 53;
+const uint16_t DNS_LOCAL_PORT = 1053;
+
+const long DNS_TIMEOUT = 2000L; // 2sec for each attempt
+const uint8_t DNS_ATTEMPTS = 3;
+
+const unsigned long DNS_MIN_TTL = 60; // 1min, in seconds
+const unsigned long DNS_MAX_TTL = 3600; // 1h, in seconds
+
+const uint8_t DNS_CACHE_SIZE = 4;
+
+const uint16_t DNS_FLAG_RESPONSE = 0x8000;
+const uint16_t DNS_FLAG_RECURSION = 0x0100;
+const uint16_t DNS_RCODE_MASK = 0x000f;
+const uint16_t DNS_TYPE_A = 1;
+const uint16_t DNS_CLASS_IN = 1;
+
+struct DnsEntry {
+  const char* host; // nullptr -- free
+  IPAddress ip;
+  Timeout expire;
+};
+
+DnsEntry dnsCache[DNS_CACHE_SIZE];
+uint8_t dnsCacheNext; // entry that is replaced when cache is full
+
+EthernetUDP dnsUdp;
+const char* queryHost; // nullptr -- no query in progress
+const char* failedHost; // query failed, reported on next resolveHost
+uint16_t queryId; // random for each query
+uint8_t queryAttempt;
+Timeout queryTimeout;
+
+DnsEntry* findEntry(const char* host) {
+  for (uint8_t i = 0; i < DNS_CACHE_SIZE; i++) {
+    DnsEntry& e = dnsCache[i];
+    if (e.host != nullptr && e.expire.check())
+      e.host = nullptr;
+    if (e.host != nullptr && strcmp(e.host, host) == 0)
+      return &e;
+  }
+  return nullptr;
+}
+
+void storeEntry(const char* host, IPAddress ip, unsigned long ttl) {
+  DnsEntry* e = findEntry(host);
+  if (e == nullptr) {
+    for (uint8_t i = 0; i < DNS_CACHE_SIZE && e == nullptr; i++)
+      if (dnsCache[i].host == nullptr)
+        e = &dnsCache[i];
+  }
+  if (e == nullptr) {
+    e = &dnsCache[dnsCacheNext];
+    dnsCacheNext = (dnsCacheNext + 1) % DNS_CACHE_SIZE;
+  }
+  e->host = host;
+  e->ip = ip;
+  e->expire.reset(constrain(ttl, DNS_MIN_TTL, DNS_MAX_TTL) * Timeout::SECOND);
+}
+
+void write16(uint16_t v) {
+  dnsUdp.write((uint8_t)(v >> 8));
+  dnsUdp.write((uint8_t)v);
+}
+
+uint16_t read16() {
+  uint16_t v = (uint8_t)dnsUdp.read() << 8;
+  return v | (uint8_t)dnsUdp.read();
+}
+
+void skip(uint16_t n) {
+  while (n-- > 0 && dnsUdp.available() > 0)
+    dnsUdp.read();
+}
+
+// name is either a sequence of labels or ends with a pointer to labels elsewhere in packet
+void skipName() {
+  while (dnsUdp.available() > 0) {
+    uint8_t len = dnsUdp.read();
+    if (len == 0)
+      return;
+    if ((len & 0xc0) == 0xc0) {
+      dnsUdp.read();
+      return;
+    }
+    skip(len);
+  }
+}
+
+bool sendQuery() {
+  if (!dnsUdp.beginPacket(Ethernet.dnsServerIP(), DNS_PORT))
+    return false;
+  write16(queryId);
+  write16(DNS_FLAG_RECURSION);
+  write16(1); // questions
+  write16(0); // answers
+  write16(0); // authority records
+  write16(0); // additional records
+  const char* label = queryHost;
+  while (*label != 0) {
+    const char* end = strchr(label, '.');
+    uint8_t len = end == nullptr ? strlen(label) : end - label;
+    dnsUdp.write(len);
+    dnsUdp.write((const uint8_t*)label, len);
+    label += len;
+    if (*label == '.')
+      label++;
+  }
+  dnsUdp.write((uint8_t)0);
+  write16(DNS_TYPE_A);
+  write16(DNS_CLASS_IN);
+  queryTimeout.reset(DNS_TIMEOUT);
+  return dnsUdp.endPacket();
+}
+
+void doneQuery(bool success) {
+  dnsUdp.stop();
+  if (!success) {
+    log.print(queryHost);
+    log.println(": failed to resolve");
+    failedHost = queryHost;
+  }
+  queryHost = nullptr;
+}
+
+// reads one packet, returns DNS_PENDING when there is no answer to current query yet
+int8_t readAnswer() {
+  if (dnsUdp.parsePacket() <= 0)
+    return DNS_PENDING;
+  if ((uint32_t)dnsUdp.remoteIP() != (uint32_t)Ethernet.dnsServerIP() || dnsUdp.remotePort() != DNS_PORT)
+    return DNS_PENDING; // not from server that was asked, possibly spoofed
+  uint16_t id = read16();
+  uint16_t flags = read16();
+  if (id != queryId || (flags & DNS_FLAG_RESPONSE) == 0)
+    return DNS_PENDING; // stray packet
+  if ((flags & DNS_RCODE_MASK) != 0)
+    return DNS_FAILED;
+  uint16_t questions = read16();
+  uint16_t answers = read16();
+  skip(4); // authority & additional records
+  for (uint16_t i = 0; i < questions && dnsUdp.available() > 0; i++) {
+    skipName();
+    skip(4); // type & class
+  }
+  for (uint16_t i = 0; i < answers && dnsUdp.available() > 0; i++) {
+    skipName();
+    uint16_t type = read16();
+    uint16_t cls = read16();
+    unsigned long ttl = (unsigned long)read16() << 16;
+    ttl |= read16();
+    uint16_t len = read16();
+    if (type == DNS_TYPE_A && cls == DNS_CLASS_IN && len == 4) {
+      IPAddress ip;
+      for (uint8_t j = 0; j < 4; j++)
+        ip[j] = dnsUdp.read();
+      storeEntry(queryHost, ip, ttl);
+      return DNS_RESOLVED;
+    }
+    skip(len); // CNAME or other record
+  }
+  return DNS_FAILED;
+}
+
+int8_t resolveHost(const char* host, IPAddress& ip) {
+  if (ip.fromString(host))
+    return DNS_RESOLVED;
+  DnsEntry* e = findEntry(host);
+  if (e != nullptr) {
+    ip = e->ip;
+    return DNS_RESOLVED;
+  }
+  if (failedHost != nullptr && strcmp(failedHost, host) == 0) {
+    failedHost = nullptr;
+    return DNS_FAILED;
+  }
+  if (queryHost != nullptr)
+    return DNS_PENDING; // wait until query for this or other host completes
+  if (!dnsUdp.begin(DNS_LOCAL_PORT)) {
+    log.println("DNS: no free socket");
+    return DNS_FAILED;
+  }
+  queryHost = host;
+  queryId = random(0x10000); // not guessable by spoofed answers
+  queryAttempt = 1;
+  if (!sendQuery()) {
+    doneQuery(false);
+    failedHost = nullptr;
+    return DNS_FAILED;
+  }
+  return DNS_PENDING;
+}
+
+void forgetHost(const char* host) {
+  DnsEntry* e = findEntry(host);
+  if (e != nullptr)
+    e->host = nullptr;
+}
+
+void checkDns() {
+  if (queryHost == nullptr)
+    return;
+  int8_t result = readAnswer();
+  if (result == DNS_PENDING) {
+    if (!queryTimeout.check())
+      return;
+    if (queryAttempt < DNS_ATTEMPTS) {
+      queryAttempt++;
+      if (sendQuery())
+        return;
+    }
+  }
+  doneQuery(result == DNS_RESOLVED);
+}
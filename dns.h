@@ -0,0 +1,19 @@
+#ifndef DNS_H_
+#define DNS_H_
+
+#include <Arduino.h>
+#include <IPAddress.h>
+
+// Host names are resolved over UDP in background, one query at a time, resolved addresses are cached
+
+const uint8_t DNS_SOCKETS = 1; // taken while query is in progress
+
+const int8_t DNS_FAILED = -1;
+const int8_t DNS_PENDING = 0;
+const int8_t DNS_RESOLVED = 1;
+
+int8_t resolveHost(const char* host, IPAddress& ip); // never blocks, call again while DNS_PENDING
+void forgetHost(const char* host); // connection to cached address failed
+void checkDns(); // reads answer to query in progress, call from loop
+
+#endif
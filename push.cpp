@@ -1,9 +1,15 @@
 #include <Arduino.h>
 #include <Ethernet2.h>
+#include <utility/w5500.h>
+#include <utility/socket.h>
 #include <FixNum.h>
 
 #include "push.h"
 #include "msgbuf.h"
+#include "HttpServer.h"
+#include "dns.h"
+#include "queue.h"
+#include "deflate.h"
 
 #define log SerialUSB
 
@@ -14,8 +20,11 @@ const char MESSAGE_IN_ID = '4';
 
 /* Data intervals */
 const long INITIAL_INTERVAL = 60000L; // 1min
-const long RETRY_INTERVAL = 10000L;   // 10sec
-const long NEXT_INTERVAL = 300000L;   // 5min
+const long RETRY_INTERVAL = 10000L;   // 10sec, doubled after each failure up to NEXT_INTERVAL
+const long DRAIN_INTERVAL = 5000L;    // 5sec, while queued values or the rest of full request are sent
+
+const uint8_t MAX_RETRY_SHIFT = 5; // 10sec << 5 is over NEXT_INTERVAL
+const uint16_t QUEUE_BATCH = 64; // queued values sent with each request
 
 /* Message intervals */
 const long INITIAL_MSG_WAIT = 3000L;   // 3sec
@@ -24,19 +33,75 @@ const long POLL_MSG_INTERVAL = 60000L; // 1min
 /* Timeout for any HTTP interaction */
 const long PUSH_TIMEOUT = 30000L; // 30sec
 
-const int MAX_PACKET = 1000;
+/* Timeout for host resolution and TCP handshake, they are done in background */
+const long CONNECT_TIMEOUT = 10000L; // 10sec
+
+/* Idle connection is closed after this time */
+const long KEEP_ALIVE_TIMEOUT = 60000L; // 1min
+
+/* Sockets that destinations may hold at once, the rest of W5500 sockets are left to HTTP server */
+const uint8_t PUSH_SOCKETS = 4;
+
+static_assert(PUSH_SOCKETS + HTTP_SERVER_SOCKETS + DNS_SOCKETS <= MAX_SOCK_NUM, "W5500 has MAX_SOCK_NUM sockets");
+
+const uint16_t FIRST_LOCAL_PORT = 49152; // ephemeral ports
+
+const uint8_t CONNECT_NONE = 0;    // connected or not sending
+const uint8_t CONNECT_RESOLVE = 1; // waiting for address of host
+const uint8_t CONNECT_WAIT = 2;    // waiting for TCP handshake
+
+const int MAX_MSG_PACKET = MSGBUF_SIZE; // messages that do not fit are sent with next request
 const int MAX_NUM_LEN = 10;
+const int TIME_LEN = 16; // 20yy-MM-ddThh:mm
+const int SEGMENT_SIZE = 128; // request is written to socket in pieces of this size
+const int MAX_LINE_TAIL = MAX_NUM_LEN + 1 + TIME_LEN + 1; // value, time & newline of CSV line after tag
+const long MAX_CONTENT_LENGTH = 99999; // for size of headers, request fits into W5500 TX buffer
 
-const byte MASK_ALL = 0xff;
+const int HISTORY_SIZE = 96; // history values kept until sent
 
-PushItem* last_item = nullptr;
+const uint8_t BINARY_VERSION = 2; // 2 -- queued section
+const uint8_t BINARY_FULL = 0x80; // flag of new session: dictionary starts anew, deltas are against 0
+
+const uint8_t MAX_VARINT = 5; // bytes of 32-bit varint
+
+const int16_t SAMPLE_GAP = -32768; // no values in sample interval
+const int16_t SAMPLE_WIDE = -32767; // delta is in PushSeries::wide
+const int16_t MAX_DELTA = 32767; // the other end is taken by codes above
+
+struct PushRate {
+  unsigned long interval;  // min time between reports of changed value
+  unsigned long heartbeat; // max time between reports
+};
+
+const PushRate PUSH_RATES[] = {
+  { 0, 900000L },           // PUSH_FAST: 15min heartbeat
+  { 900000L, 3600000L }     // PUSH_SLOW: 15min, 1h heartbeat
+};
+
+// timestamped values that are sent once to every data destination
+struct PushRecord {
+  PushId id;
+  int32_t val;
+  PushTime time;
+  byte updated;
+  byte sending;
+};
+
+PushRecord history[HISTORY_SIZE];
+int historySize;
+byte dataMasks; // masks of destinations that send data
+unsigned long printTime; // time of request, samples are sent with time relative to it
 
 const char HTTP_RES[] = "HTTP/1.1";
 const char HTTP_OK[] = "HTTP/1.1 200 OK";
+const char HTTP_UNSUPPORTED[] = "HTTP/1.1 415";
 const char PUT[] = "PUT";
 const char POST[] = "POST";
 const char COOKIE[] = "Cookie: ";
 const char SET_COOKIE[] = "Set-Cookie: ";
+const char CONTENT_LENGTH[] = "Content-Length:";
+const char CONNECTION[] = "Connection:";
+const char CLOSE[] = "close";
 
 const int RESPONSE_LINE1       = 0;  // 1st line of response
 const int RESPONSE_HEADERS0    = 1;  // response headers start of line; '\n' was seen
@@ -57,148 +122,841 @@ const int PBODY_STATE_IDX   = 4;  // parsing index
 const int PBODY_STATE_DONE  = 5;  // successfully parsed
 const int PBODY_STATE_ERR   = 6;  // error
 
-const int MAX_RESPONSE = 300;
+long pushInterval = NEXT_INTERVAL;
+
+PushDest* lastDest;
+uint8_t openSockets; // sockets taken by connections of destinations
+uint16_t localPort = FIRST_LOCAL_PORT;
+
+char msgPacket[MAX_MSG_PACKET + 1];
+
+// counts written bytes to compute Content-Length before the body is written
+class CountPrint : public Print {
+public:
+  long count = 0;
+  virtual size_t write(uint8_t c) {
+    count++;
+    return 1;
+  }
+};
+
+// collects small writes into larger ones, every write to socket is sent as a separate TCP segment
+class SegmentPrint : public Print {
+private:
+  Print& _out;
+  uint8_t _buf[SEGMENT_SIZE];
+  int _size = 0;
+public:
+  SegmentPrint(Print& out) : _out(out) {}
+  virtual size_t write(uint8_t c) {
+    if (_size == SEGMENT_SIZE)
+      flush();
+    _buf[_size++] = c;
+    return 1;
+  }
+  virtual void flush() {
+    if (_size > 0)
+      _out.write(_buf, _size);
+    _size = 0;
+  }
+};
+
+// Raw body: printers check that the next piece fits before printing it and leave the rest for the next
+// request, so that whole request fits into free TX buffer of socket and is written without waiting
+class BodyPrint : public Print {
+private:
+  Print& _out;
+  long _limit;
+public:
+  long count = 0;
+  bool full = false; // something was left for the next request
+  BodyPrint(Print& out, long limit) : _out(out), _limit(limit) {}
+  virtual size_t write(uint8_t c) {
+    count++;
+    return _out.write(c);
+  }
+  virtual size_t write(const uint8_t* buf, size_t size) {
+    count += size;
+    return _out.write(buf, size);
+  }
+  using Print::write;
+  bool fits(long n) {
+    if (count + n <= _limit)
+      return true;
+    full = true;
+    return false;
+  }
+};
+
+int formatTime(PushTime& time, char* s) {
+  s[0] = '2';
+  s[1] = '0';
+  formatDecimal(time.year, s + 2, 2, FMT_ZERO);
+  s[4] = '-';
+  formatDecimal(time.month, s + 5, 2, FMT_ZERO);
+  s[7] = '-';
+  formatDecimal(time.date, s + 8, 2, FMT_ZERO);
+  s[10] = 'T';
+  formatDecimal(time.hour, s + 11, 2, FMT_ZERO);
+  s[13] = ':';
+  formatDecimal(time.minute, s + 14, 2, FMT_ZERO);
+  return TIME_LEN;
+}
+
+void loadTag(PushId id, PushTag& tag) {
+  memcpy_P(&tag, &PUSH_TAGS[id], sizeof(PushTag));
+}
+
+// converts value to the given precision
+int32_t convertPrec(int32_t val, prec_t from, prec_t to) {
+  for (; from < to; from++) val *= 10;
+  for (; from > to; from--) val /= 10;
+  return val;
+}
+
+void printItem(Print& out, PushTag& tag, int32_t val) {
+  char num[MAX_NUM_LEN];
+  out.write((const uint8_t*)tag.line, tag.len);
+  out.write((uint8_t*)num, formatDecimal(val, num, MAX_NUM_LEN, tag.prec));
+}
+
+// prints ,<ms relative to request> and ends line
+void printRelTime(Print& out, unsigned long time) {
+  char s[MAX_NUM_LEN];
+  out.print(',');
+  out.write((uint8_t*)s, formatDecimal((int32_t)(time - printTime), s, MAX_NUM_LEN, FMT_SIGN));
+  out.print('\n');
+}
+
+// index of destination in per-destination state of series
+uint8_t maskBit(byte mask) {
+  uint8_t b = 0;
+  while (b < MASK_BITS - 1 && (mask & (1 << b)) == 0)
+    b++;
+  return b;
+}
+
+// delta of sample k that is not a gap, w is index of the next wide delta
+int32_t sampleDelta(PushSeries* s, uint8_t k, uint8_t& w) {
+  int16_t d = s->deltas[(s->head + k) % s->capacity];
+  return d == SAMPLE_WIDE ? s->wide[w++] : d;
+}
+
+bool sampleGap(PushSeries* s, uint8_t k) {
+  return s->deltas[(s->head + k) % s->capacity] == SAMPLE_GAP;
+}
+
+// quantized value before sample k, samples before it are summed from base; w is set to index of its wide delta
+int32_t sampleValue(PushSeries* s, uint8_t k, uint8_t& w) {
+  int32_t q = s->base;
+  w = 0;
+  for (uint8_t i = 0; i < k; i++)
+    if (!sampleGap(s, i)) q += sampleDelta(s, i, w);
+  return q;
+}
+
+// sample line: H<tag>,<value>,<end of sample interval, ms relative to request>
+// samples that destination has already received are skipped, returns false when request is full
+bool printSeries(BodyPrint& out, PushTag& tag, PushSeries* s, byte mask) {
+  uint8_t b = maskBit(mask);
+  uint8_t first = s->acked[b];
+  uint8_t w;
+  int32_t q = sampleValue(s, first, w);
+  uint8_t k = first;
+  for (; k < s->count; k++) {
+    if (sampleGap(s, k)) continue;
+    if (!out.fits(tag.len + MAX_LINE_TAIL)) break;
+    q += sampleDelta(s, k, w);
+    printItem(out, tag, q * s->quantum);
+    printRelTime(out, s->time - (s->count - 1 - k) * s->interval);
+  }
+  s->sending[b] = k;
+  return k == s->count;
+}
+
+// queued line: H<tag>,<value>,<time of report, ms relative to request>, the oldest are sent first
+void printQueue(BodyPrint& out, PushQueue* queue) {
+  PushTag tag;
+  QueueRecord rec;
+  uint16_t n = min(queue->count(), QUEUE_BATCH);
+  uint16_t i = 0;
+  for (; i < n; i++) {
+    queue->peek(i, rec);
+    loadTag(rec.id, tag);
+    if (!out.fits(tag.len + MAX_LINE_TAIL)) break;
+    printItem(out, tag, rec.val);
+    printRelTime(out, rec.time);
+  }
+  queue->startSend(i);
+}
+
+// prints values that were updated for destination and marks them as being sent,
+// stops at the first one that does not fit
+void printData(BodyPrint& out, byte mask) {
+  PushTag tag;
+  for (PushId id = 0; id < PUSH_TAG_COUNT; id++) {
+    PushItem& item = pushItems[id];
+    loadTag(id, tag);
+    if (item.series != nullptr && (tag.mask & mask) != 0 && !printSeries(out, tag, item.series, mask)) return;
+    if ((item.updated & mask) == 0) continue;
+    if (!out.fits(tag.len + MAX_LINE_TAIL)) return;
+    item.sending |= mask;
+    printItem(out, tag, item.val);
+    out.print('\n');
+  }
+  for (int i = 0; i < historySize; i++) {
+    PushRecord& rec = history[i];
+    if ((rec.updated & mask) == 0) continue;
+    loadTag(rec.id, tag);
+    if (!out.fits(tag.len + MAX_LINE_TAIL)) return;
+    rec.sending |= mask;
+    char time[TIME_LEN];
+    printItem(out, tag, rec.val);
+    out.print(',');
+    out.write((uint8_t*)time, formatTime(rec.time, time));
+    out.print('\n');
+  }
+}
+
+//------- BINARY FORMAT ------
+
+// Body: version | flags, then sections, each starts with varint number of entries
+//   dictionary: varint id, byte length, tag -- in new session only
+//   queued:     varint id << 3 | prec, zig-zag varint value, zig-zag varint ms when reported, relative to request
+//   values:     varint id << 3 | prec, zig-zag varint delta against acked value
+//   history:    varint id << 3 | prec, zig-zag varint value, year, month, date, hour, minute
+//   series:     varint id << 3 | prec, varint interval ms, varint quantum,
+//               zig-zag varint end of last interval, ms relative to request, varint n,
+//               n samples: 0 -- gap, zig-zag varint delta in quanta << 1 | 1
+// Deltas of series samples are against the previous sample, the first one -- against 0.
 
-EthernetClient client;
-bool clientBusy;
+void printVarint(Print& out, uint32_t v) {
+  while (v >= 0x80) {
+    out.write((uint8_t)(v | 0x80));
+    v >>= 7;
+  }
+  out.write((uint8_t)v);
+}
+
+uint32_t zigzag(int32_t v) {
+  return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+uint8_t varintSize(uint32_t v) {
+  uint8_t n = 1;
+  for (; v >= 0x80; v >>= 7)
+    n++;
+  return n;
+}
+
+uint32_t binaryKey(PushId id, PushTag& tag) {
+  return ((uint32_t)id << 3) | tag.prec;
+}
 
-int responsePart;
-int responseSize;
-char response[MAX_RESPONSE + 1];
+void printKey(Print& out, PushId id, PushTag& tag) {
+  printVarint(out, binaryKey(id, tag));
+}
 
-char packet[MAX_PACKET + 1];
+void printBinaryDict(Print& out) {
+  PushTag tag;
+  printVarint(out, PUSH_TAG_COUNT);
+  for (PushId id = 0; id < PUSH_TAG_COUNT; id++) {
+    loadTag(id, tag);
+    printVarint(out, id);
+    out.write(tag.len - 2);
+    out.write((const uint8_t*)tag.line + 1, tag.len - 2); // without H and comma
+  }
+}
+
+// samples from acked to sending ones
+void printBinarySeries(Print& out, PushId id, PushTag& tag, PushSeries* s, uint8_t b) {
+  uint8_t first = s->acked[b];
+  uint8_t end = s->sending[b];
+  printKey(out, id, tag);
+  printVarint(out, s->interval);
+  printVarint(out, s->quantum);
+  printVarint(out, zigzag(s->time - (s->count - end) * s->interval - printTime));
+  printVarint(out, end - first);
+  uint8_t w;
+  int32_t q = sampleValue(s, first, w);
+  int32_t prev = 0;
+  for (uint8_t k = first; k < end; k++) {
+    if (sampleGap(s, k)) {
+      out.write((uint8_t)0);
+      continue;
+    }
+    q += sampleDelta(s, k, w);
+    printVarint(out, (zigzag(q - prev) << 1) | 1);
+    prev = q;
+  }
+}
 
-byte composeDataPacket(byte mask, bool &next) {
-  int size = 0;
-  next = false;
-  for (PushItem* cur = last_item; cur != nullptr; cur = cur->next) {
-    if (cur->updated & mask == 0) continue;
-    int tagLen = strlen(cur->tag);
-    int reqLen = 1 + tagLen + 1 + MAX_NUM_LEN + 1;
-    if (size + reqLen >= MAX_PACKET) {
-      next = true;
-      break;
+// marks samples that fit after size bytes as being sent, returns size of series entry, 0 -- no samples fit
+long fitBinarySeries(BodyPrint& out, long size, PushId id, PushTag& tag, PushSeries* s, uint8_t b) {
+  long e = varintSize(binaryKey(id, tag)) + varintSize(s->interval) + varintSize(s->quantum) + 2 * MAX_VARINT;
+  uint8_t k = s->acked[b];
+  uint8_t w;
+  int32_t q = sampleValue(s, k, w);
+  int32_t prev = 0;
+  for (; k < s->count; k++) {
+    bool gap = sampleGap(s, k);
+    uint8_t next = w;
+    int32_t d = gap ? 0 : sampleDelta(s, k, next);
+    uint8_t n = gap ? 1 : varintSize((zigzag(q + d - prev) << 1) | 1);
+    if (!out.fits(size + e + n)) break;
+    e += n;
+    w = next;
+    if (!gap) {
+      q += d;
+      prev = q;
     }
-    cur->sending |= mask;
-    packet[size++] = LOCATION_PREFIX;
-    strncpy(packet + size, cur->tag, tagLen);
-    size += tagLen;
-    packet[size++] = ',';
-    int numLen = formatDecimal(cur->val, packet + size, MAX_NUM_LEN, cur->prec);
-    size += numLen;
-    packet[size++] = '\n';
   }
-  packet[size] = 0;
-  return size;
+  s->sending[b] = k;
+  return k > s->acked[b] ? e : 0;
+}
+
+// queued values are absolute, like in CSV
+void printBinaryQueue(BodyPrint& out, PushQueue* queue) {
+  PushTag tag;
+  QueueRecord rec;
+  long size = 4 * MAX_VARINT; // counts of sections
+  uint16_t n = queue == nullptr ? 0 : min(queue->count(), QUEUE_BATCH);
+  uint16_t i = 0;
+  for (; i < n; i++) {
+    queue->peek(i, rec);
+    loadTag(rec.id, tag);
+    long e = varintSize(binaryKey(rec.id, tag)) + varintSize(zigzag(rec.val)) + MAX_VARINT;
+    if (!out.fits(size + e)) break;
+    size += e;
+  }
+  printVarint(out, i);
+  for (uint16_t k = 0; k < i; k++) {
+    queue->peek(k, rec);
+    loadTag(rec.id, tag);
+    printKey(out, rec.id, tag);
+    printVarint(out, zigzag(rec.val));
+    printVarint(out, zigzag(rec.time - printTime));
+  }
+  if (queue != nullptr)
+    queue->startSend(i);
+}
+
+// dictionary is sent on new session, values -- as deltas against acked ones.
+// Entries of each section are counted before it is printed, so those that fit are marked first.
+void printBinaryData(BodyPrint& out, byte mask, bool session, PushQueue* queue) {
+  PushTag tag;
+  uint8_t b = maskBit(mask);
+  out.write((uint8_t)(BINARY_VERSION | (session ? 0 : BINARY_FULL)));
+  if (session)
+    printVarint(out, 0);
+  else
+    printBinaryDict(out); // always whole, values refer to it
+  printBinaryQueue(out, queue);
+  long size = 3 * MAX_VARINT; // counts of sections
+  int n = 0;
+  for (PushId id = 0; id < PUSH_TAG_COUNT; id++) {
+    PushItem& item = pushItems[id];
+    if ((item.updated & mask) == 0) continue;
+    loadTag(id, tag);
+    long e = varintSize(binaryKey(id, tag)) + varintSize(zigzag(item.val - (session ? item.acked : 0)));
+    if (!out.fits(size + e)) break;
+    size += e;
+    item.sending |= mask;
+    item.sent = item.val;
+    n++;
+  }
+  printVarint(out, n);
+  for (PushId id = 0; id < PUSH_TAG_COUNT; id++) {
+    PushItem& item = pushItems[id];
+    if ((item.sending & mask) == 0) continue;
+    loadTag(id, tag);
+    printKey(out, id, tag);
+    printVarint(out, zigzag(item.sent - (session ? item.acked : 0)));
+  }
+  size = 2 * MAX_VARINT;
+  n = 0;
+  for (int i = 0; i < historySize; i++) {
+    PushRecord& rec = history[i];
+    if ((rec.updated & mask) == 0) continue;
+    loadTag(rec.id, tag);
+    long e = varintSize(binaryKey(rec.id, tag)) + varintSize(zigzag(rec.val)) + 5;
+    if (!out.fits(size + e)) break;
+    size += e;
+    rec.sending |= mask;
+    n++;
+  }
+  printVarint(out, n);
+  for (int i = 0; i < historySize; i++) {
+    PushRecord& rec = history[i];
+    if ((rec.sending & mask) == 0) continue;
+    loadTag(rec.id, tag);
+    printKey(out, rec.id, tag);
+    printVarint(out, zigzag(rec.val));
+    uint8_t time[] = { rec.time.year, rec.time.month, rec.time.date, rec.time.hour, rec.time.minute };
+    out.write(time, sizeof(time));
+  }
+  size = MAX_VARINT;
+  n = 0;
+  for (PushId id = 0; id < PUSH_TAG_COUNT; id++) {
+    PushSeries* s = pushItems[id].series;
+    if (s == nullptr || s->acked[b] == s->count) continue;
+    loadTag(id, tag);
+    if ((tag.mask & mask) == 0) continue;
+    long e = fitBinarySeries(out, size, id, tag, s, b);
+    if (e == 0) break;
+    size += e;
+    n++;
+  }
+  printVarint(out, n);
+  for (PushId id = 0; id < PUSH_TAG_COUNT; id++) {
+    PushSeries* s = pushItems[id].series;
+    if (s == nullptr || s->sending[b] <= s->acked[b]) continue;
+    loadTag(id, tag);
+    printBinarySeries(out, id, tag, s, b);
+  }
+}
+
+// values that were sent become base for deltas, new session starts from 0 for those that were not
+void markAcked(byte mask, bool session) {
+  for (PushId id = 0; id < PUSH_TAG_COUNT; id++) {
+    PushItem& item = pushItems[id];
+    if (item.sending & mask)
+      item.acked = item.sent;
+    else if (!session)
+      item.acked = 0;
+  }
+}
+
+//------- SENT VALUES ------
+
+// marks of previous printing are cleared: request is printed twice and again after reconnect
+void clearSending(byte mask) {
+  uint8_t b = maskBit(mask);
+  for (PushId id = 0; id < PUSH_TAG_COUNT; id++) {
+    PushItem& item = pushItems[id];
+    item.sending &= ~mask;
+    if (item.series != nullptr) item.series->sending[b] = 0;
+  }
+  for (int i = 0; i < historySize; i++)
+    history[i].sending &= ~mask;
+}
+
+// something is waiting to be sent to destination, nothing is marked
+bool hasData(byte mask) {
+  PushTag tag;
+  uint8_t b = maskBit(mask);
+  for (PushId id = 0; id < PUSH_TAG_COUNT; id++) {
+    PushItem& item = pushItems[id];
+    if (item.updated & mask) return true;
+    if (item.series == nullptr || item.series->acked[b] == item.series->count) continue;
+    loadTag(id, tag);
+    if (tag.mask & mask) return true;
+  }
+  for (int i = 0; i < historySize; i++)
+    if (history[i].updated & mask) return true;
+  return false;
+}
+
+// values that failed to upload are queued, so that later changes do not overwrite them;
+// they are the updated ones, not only those in request, which is not printed when connection fails
+void queueUpdated(PushQueue* queue, byte mask) {
+  for (PushId id = 0; id < PUSH_TAG_COUNT; id++) {
+    PushItem& item = pushItems[id];
+    if ((item.updated & mask) == 0) continue;
+    queue->add(QueueRecord{id, item.reported, item.time});
+    item.updated &= ~mask;
+  }
+}
+
+// drops the oldest sample
+void dropSample(PushSeries* s) {
+  int16_t d = s->deltas[s->head];
+  if (d == SAMPLE_WIDE) {
+    s->base += s->wide[0];
+    s->wideCount--;
+    memmove(s->wide, s->wide + 1, s->wideCount * sizeof(int32_t));
+  } else if (d != SAMPLE_GAP) {
+    s->base += d;
+  }
+  s->head = (s->head + 1) % s->capacity;
+  s->count--;
+  for (uint8_t b = 0; b < MASK_BITS; b++) {
+    if (s->acked[b] > 0) s->acked[b]--;
+    if (s->sending[b] > 0) s->sending[b]--;
+  }
+}
+
+// samples are dropped once uploaded to every data destination of tag
+void markSeriesSent(PushSeries* s, byte mask, byte destMask, bool success) {
+  uint8_t b = maskBit(mask);
+  if (success && s->sending[b] > s->acked[b]) s->acked[b] = s->sending[b];
+  s->sending[b] = 0;
+  uint8_t n = s->count;
+  for (b = 0; b < MASK_BITS; b++)
+    if ((destMask & (1 << b)) != 0 && s->acked[b] < n)
+      n = s->acked[b];
+  for (; n > 0; n--)
+    dropSample(s);
 }
 
 void markSent(byte mask, bool success) {
-  for (PushItem* cur = last_item; cur != nullptr; cur = cur->next) {
-    if (cur->sending & mask == 0) continue;
-    cur->sending &= ~mask;
-    if (success) cur->updated &= ~mask;
+  PushTag tag;
+  for (PushId id = 0; id < PUSH_TAG_COUNT; id++) {
+    PushItem& item = pushItems[id];
+    if (item.series != nullptr) {
+      loadTag(id, tag);
+      if ((tag.mask & mask) != 0) markSeriesSent(item.series, mask, tag.mask & dataMasks, success);
+    }
+    if ((item.sending & mask) == 0) continue;
+    item.sending &= ~mask;
+    if (success) item.updated &= ~mask;
+  }
+  // remove history records that were sent to all data destinations
+  int n = 0;
+  for (int i = 0; i < historySize; i++) {
+    PushRecord& rec = history[i];
+    if (rec.sending & mask) {
+      rec.sending &= ~mask;
+      if (success) rec.updated &= ~mask;
+    }
+    if ((rec.updated & dataMasks) != 0)
+      history[n++] = rec;
   }
+  historySize = n;
 }
 
-PushDest::PushDest(byte mask, char* host, int port, char* url, char* auth) :
+PushDest::PushDest(byte mask, char* host, int port, char* url, char* auth, uint8_t format, PushQueue* queue) :
   _period(INITIAL_INTERVAL),
   _timeout(PUSH_TIMEOUT)
 {
+  _format = format & ~PUSH_DEFLATE;
+  _deflate = (format & PUSH_DEFLATE) != 0;
   _mask = mask;
   _host = host;
   _port = port;
   _url = url;
   _auth = auth;
   _method = PUT;
+  _queue = queue;
+  _next = lastDest;
+  lastDest = this;
 }
 
-bool PushDest::sendPacket(byte size) {
+void PushDest::closeClient() {
+  if (!_connected)
+    return;
+  _client.stop();
+  _connected = false;
+  openSockets--;
+}
+
+// closes kept alive connection that is not used right now, returns true if socket was freed
+bool PushDest::closeIdle() {
+  if (!_connected || _sending)
+    return false;
+  closeClient();
+  return true;
+}
+
+void PushDest::checkIdle() {
+  for (PushDest* dest = lastDest; dest != nullptr; dest = dest->_next)
+    if (!dest->_sending && dest->_connected && (dest->_idle.check() || !dest->_client.connected()))
+      dest->closeClient(); // idle or closed by server
+}
+
+// when all sockets are taken, idle connection of some other destination is closed
+bool PushDest::openSocket() {
+  if (openSockets >= PUSH_SOCKETS) {
+    for (PushDest* dest = lastDest; dest != nullptr; dest = dest->_next)
+      if (dest->closeIdle())
+        break;
+  }
+  if (openSockets >= PUSH_SOCKETS)
+    return false;
+  _sock = MAX_SOCK_NUM;
+  for (uint8_t i = 0; i < MAX_SOCK_NUM && _sock == MAX_SOCK_NUM; i++)
+    if (w5500.readSnSR(i) == SnSR::CLOSED)
+      _sock = i;
+  if (_sock == MAX_SOCK_NUM)
+    return false;
+  if (++localPort == 0)
+    localPort = FIRST_LOCAL_PORT;
+  uint8_t addr[4] = { _ip[0], _ip[1], _ip[2], _ip[3] };
+  socket(_sock, SnMR::TCP, localPort, 0);
+  if (!::connect(_sock, addr, _port)) { // only starts handshake, does not wait for it
+    close(_sock);
+    return false;
+  }
+  openSockets++;
+  return true;
+}
+
+void PushDest::connectFailed(const char* reason) {
+  _connectState = CONNECT_NONE;
+  log.print(_host);
+  log.print(": ");
+  log.println(reason);
+  doneSend(false);
+}
+
+// does one step of connection, so that loop is never blocked by unreachable host
+void PushDest::checkConnect() {
+  if (_connectState == CONNECT_RESOLVE) {
+    int8_t result = resolveHost(_host, _ip);
+    if (result == DNS_PENDING) {
+      if (_connectTimeout.check())
+        connectFailed("resolve timeout");
+      return;
+    }
+    if (result == DNS_FAILED)
+      connectFailed("failed to resolve");
+    else if (!openSocket())
+      connectFailed("no free socket");
+    else
+      _connectState = CONNECT_WAIT;
+    return;
+  }
+  uint8_t status = w5500.readSnSR(_sock);
+  if (status == SnSR::ESTABLISHED) {
+    _connectState = CONNECT_NONE;
+    _client = EthernetClient(_sock);
+    _connected = true;
+    sendPacket();
+  } else if (status == SnSR::CLOSED || _connectTimeout.check()) {
+    close(_sock);
+    openSockets--;
+    forgetHost(_host); // address might have changed
+    connectFailed("failed to connect");
+  }
+}
+
+// request is sent when connection is established
+void PushDest::startSend() {
+  _reused = _connected && _client.connected();
+  if (_reused) {
+    sendPacket();
+    return;
+  }
+  closeClient();
+  _connectState = CONNECT_RESOLVE;
+  _connectTimeout.reset(CONNECT_TIMEOUT);
+  checkConnect(); // cached address is used right away
+}
+
+// connects or reads response, returns true while request is in progress
+bool PushDest::checkRequest() {
+  if (_connectState != CONNECT_NONE) {
+    checkConnect();
+    return true;
+  }
+  return readResponse();
+}
+
+// response headers that frame response body and control connection reuse
+void PushDest::parseHeader() {
+  _header[_headerSize] = 0;
+  int cl = strlen(CONTENT_LENGTH);
+  int cn = strlen(CONNECTION);
+  if (strncasecmp(_header, CONTENT_LENGTH, cl) == 0)
+    _contentLength = atol(_header + cl);
+  else if (strncasecmp(_header, CONNECTION, cn) == 0) {
+    char* v = _header + cn;
+    while (*v == ' ')
+      v++;
+    if (strncasecmp(v, CLOSE, strlen(CLOSE)) == 0)
+      _keepAlive = false;
+  }
+  _headerSize = 0;
+}
+
+bool PushDest::responseDone() {
+  return _responsePart == RESPONSE_BODY && _contentLength >= 0 && _bodySize >= _contentLength;
+}
+
+void PushDest::printBody(BodyPrint& out) {
+  clearSending(_mask);
+  if (_format == PUSH_BINARY) {
+    printBinaryData(out, _mask, _session, _queue);
+    return;
+  }
+  if (_queue != nullptr)
+    printQueue(out, _queue);
+  printData(out, _mask);
+}
+
+// body as it is sent, compressor encodes it while it is printed;
+// limit is for raw body, returns true if something was left for the next request
+bool PushDest::printContent(Print& out, long limit) {
+  if (!_deflate) {
+    BodyPrint body(out, limit);
+    printBody(body);
+    return body.full;
+  }
+  DeflatePrint deflate(out);
+  BodyPrint body(deflate, limit);
+  printBody(body);
+  deflate.finish();
+  return body.full;
+}
+
+// request is limited to free TX buffer of socket, W5500 library waits for server to acknowledge data
+// that does not fit; body is printed twice: to compute its size and to write it to socket
+void PushDest::sendPacket() {
+  printTime = millis();
+  CountPrint headers;
+  printHeaders(headers, MAX_CONTENT_LENGTH);
+  long limit = (long)w5500.getTXFreeSize(_client.getSocketNumber()) - headers.count;
+  if (_deflate)
+    limit = (limit - DEFLATE_OVERHEAD) * 8 / 9;
+  CountPrint counter;
+  _more = printContent(counter, limit);
+  long size = counter.count;
   log.print(_host);
   log.print(':');
   log.print(' ');
   log.print(_method);
   log.print(' ');
   log.print(size, DEC);
-  log.println(" bytes");
-  if (!client.connect(_host, _port)) {
-    log.print(_host);
-    log.println(": failed to connect");
-    return false;
-  }
+  log.print(_deflate ? " bytes deflated" : " bytes");
+  log.println(_more ? ", more to send" : "");
+  SegmentPrint out(_client);
+  printHeaders(out, size);
+  printContent(out, limit);
+  out.flush();
+  _timeout.reset(PUSH_TIMEOUT);
+  _sending = true;
+  _responsePart = RESPONSE_LINE1;
+  _responseSize = 0;
+  _headerSize = 0;
+  _contentLength = -1;
+  _bodySize = 0;
+  _keepAlive = true;
+}
 
+void PushDest::printHeaders(Print& out, long size) {
   // PUT/POST <url> HTTP/1.1
-  client.print(_method);
-  client.print(' ');
-  client.print( _url);
-  printExtraUrlParams();
-  client.println(" HTTP/1.1");
+  out.print(_method);
+  out.print(' ');
+  out.print( _url);
+  printExtraUrlParams(out);
+  out.println(" HTTP/1.1");
 
   // Host: <host>
-  client.print("Host: ");
-  client.println(_host);
+  out.print("Host: ");
+  out.println(_host);
 
   // <auth>
-  client.println(_auth);
+  out.println(_auth);
 
   // extra stuff
-  printExtraHeaders();
+  printExtraHeaders(out);
 
-  // Connection: close
-  client.println("Connection: close");
+  if (_format == PUSH_BINARY)
+    out.println("Content-Type: application/octet-stream");
+  if (_deflate)
+    out.println("Content-Encoding: deflate");
+
+  // Connection: keep-alive
+  out.println("Connection: keep-alive");
 
   // Content-Length: <size>
-  client.print("Content-Length: ");
-  client.print(size, DEC);
-  client.println();
+  out.print("Content-Length: ");
+  out.print(size, DEC);
+  out.println();
 
-  // empty line & packet itself
-  client.println();
-  client.print(packet);
-  _timeout.reset(PUSH_TIMEOUT);
-  _sending = true;
-  responsePart = RESPONSE_LINE1;
-  responseSize = 0;
-  clientBusy = true;
-  return true;
+  // empty line, body follows
+  out.println();
 }
 
 void PushDest::doneSend(bool success) {
+  if (_format == PUSH_BINARY) {
+    // on failure server state is not known -- start new session with full dictionary & values
+    if (success) markAcked(_mask, _session);
+    _session = success;
+  }
+  if (_queue != nullptr) {
+    _queue->doneSend(success);
+    if (!success)
+      queueUpdated(_queue, _mask);
+  }
   markSent(_mask, success);
-  _period.reset(success ? NEXT_INTERVAL : RETRY_INTERVAL);
+  if (!success) {
+    _period.reset(retryInterval());
+    return;
+  }
+  _failures = 0;
+  if (_more || (_queue != nullptr && _queue->count() > 0))
+    _period.reset(min(DRAIN_INTERVAL, pushInterval)); // the rest is drained at limited rate, not in one burst
+  else
+    _period.reset(pushInterval);
+}
+
+// exponential backoff with jitter, so that controllers do not retry in lockstep after outage
+long PushDest::retryInterval() {
+  long interval = min(RETRY_INTERVAL << min(_failures, MAX_RETRY_SHIFT), NEXT_INTERVAL);
+  if (_failures < MAX_RETRY_SHIFT)
+    _failures++;
+  return interval / 2 + random(interval / 2 + 1);
+}
+
+// values acked by binary destination are kept in PushItem, so only the first declared one is served
+void PushDest::setupDests() {
+  PushDest* binary = nullptr;
+  for (PushDest* dest = lastDest; dest != nullptr; dest = dest->_next) { // in reverse order of declaration
+    if (dest->_queue != nullptr)
+      dest->_queue->begin();
+    if (dest->_format != PUSH_BINARY)
+      continue;
+    if (binary != nullptr) {
+      log.print(binary->_host);
+      log.println(": only one binary destination is supported, disabled");
+      binary->_mask = 0;
+    }
+    binary = dest;
+  }
 }
 
 void PushDest::parseChar(char ch) {
-  switch (responsePart) {
+  if (_responsePart != RESPONSE_LINE1 && _responsePart != RESPONSE_BODY) {
+    if (ch == '\n')
+      parseHeader();
+    else if (ch != '\r' && _headerSize < MAX_HEADER)
+      _header[_headerSize++] = ch;
+  }
+  switch (_responsePart) {
   case RESPONSE_LINE1:
     if (ch == '\n') {
-      responsePart = RESPONSE_HEADERS0;
+      _responsePart = RESPONSE_HEADERS0;
+      if (_responseSize < (int)strlen(HTTP_RES) || strncmp(_response, HTTP_RES, strlen(HTTP_RES)) != 0)
+        _keepAlive = false; // HTTP/1.0 closes connection by default
     } else {
-      if (ch != '\r' && responseSize < MAX_RESPONSE)
-        response[responseSize++] = ch;
+      if (ch != '\r' && _responseSize < MAX_RESPONSE)
+        _response[_responseSize++] = ch;
     }
     break;
   case RESPONSE_HEADERS0:
     if (ch == '\r')
-      responsePart = RESPONSE_HEADERS1;
+      _responsePart = RESPONSE_HEADERS1;
     else if (ch == '\n')
-      responsePart = RESPONSE_BODY;
+      _responsePart = RESPONSE_BODY;
     else
-      responsePart = RESPONSE_HEADERS_ANY;
+      _responsePart = RESPONSE_HEADERS_ANY;
     parseResponseHeaders(ch);
     break;
   case RESPONSE_HEADERS1:
     if (ch == '\n')
-      responsePart = RESPONSE_BODY;
+      _responsePart = RESPONSE_BODY;
     else
-      responsePart = RESPONSE_HEADERS0;
+      _responsePart = RESPONSE_HEADERS0;
     parseResponseHeaders(ch);
     break;
   case RESPONSE_HEADERS_ANY:
     if (ch == '\n')
-      responsePart = RESPONSE_HEADERS0;
+      _responsePart = RESPONSE_HEADERS0;
     parseResponseHeaders(ch);
     break;
   case RESPONSE_BODY:
+    _bodySize++;
     parseResponseBody(ch);
     break;
   }
@@ -207,43 +965,106 @@ void PushDest::parseChar(char ch) {
 bool PushDest::readResponse() {
   if (!_sending)
     return false;
-  if (client.connected() && !_timeout.check()) {
-    while (client.available())
-      parseChar(client.read());
-    if (client.connected())
+  if (_client.connected() && !_timeout.check()) {
+    while (_client.available() && !responseDone())
+      parseChar(_client.read());
+    if (!responseDone() && _client.connected())
       return true; // if still connected will read more
   }
-  // not connected anymore or timeout
-  client.stop();
+  // complete response, not connected anymore or timeout
   _sending = false;
+  if (responseDone() && _keepAlive && _client.connected())
+    _idle.reset(KEEP_ALIVE_TIMEOUT);
+  else
+    closeClient();
+  if (_responsePart == RESPONSE_LINE1 && _reused) {
+    // kept alive connection was closed by server -- send again over new one
+    log.print(_host);
+    log.println(": reconnect");
+    startSend();
+    return true;
+  }
   bool ok = false;
-  if (responsePart != RESPONSE_LINE1 && strncmp(response, HTTP_RES, strlen(HTTP_RES)) == 0) {
-    response[responseSize] = 0;
-    ok = strcmp(response, HTTP_OK) == 0;
+  if (_responsePart != RESPONSE_LINE1 && strncmp(_response, HTTP_RES, strlen(HTTP_RES)) == 0) {
+    _response[_responseSize] = 0;
+    ok = strcmp(_response, HTTP_OK) == 0;
     log.print(_host);
     log.print(": ");
-    log.println(response);
+    log.println(_response);
+    if (!ok && _deflate && strncmp(_response, HTTP_UNSUPPORTED, strlen(HTTP_UNSUPPORTED)) == 0) {
+      // server does not accept compressed body -- send it as is from now on
+      _deflate = false;
+      startSend();
+      return true;
+    }
   } else {
     log.print(_host);
     log.println(": no response");
   }
   doneSend(ok);
-  clientBusy = false;
   return false; // done with response
 }
 
 void PushDest::check() {
-  if (readResponse())
+  if (_mask == 0)
+    return; // disabled
+  dataMasks |= _mask;
+  if (checkRequest())
     return; // reading response
-  if (clientBusy)
-    return; // client is busy serving some other destination
-  if (_next == 0 && !_period.check())
+  if (!_period.check())
     return;
-  byte size = composeDataPacket(_mask, _next);
-  if (size == 0)
+  if (!hasData(_mask) && (_queue == nullptr || _queue->count() == 0)) {
+    _period.reset(pushInterval); // nothing changed & nothing queued
     return;
-  if (!sendPacket(size))
-    doneSend(false);
+  }
+  startSend();
+}
+
+//------- COMMANDS ------
+
+struct CommandRoute {
+  CommandRoute* next;
+  char* name;
+  void (*func)(char* args);
+};
+
+CommandRoute* lastCommand = nullptr;
+
+// reply is collected in MsgBuf until it is saved as a message
+class MsgPrint : public Print {
+public:
+  virtual size_t write(uint8_t c) {
+    MsgBuf.putChar(c);
+    return 1;
+  }
+};
+
+MsgPrint msgPrint;
+Print& commandReply = msgPrint;
+
+void pushCommandRoute(char* name, void (*func)(char* args)) {
+  lastCommand = new CommandRoute{lastCommand, name, func};
+}
+
+void runCommand(char* msg) {
+  log.print("command: ");
+  log.println(msg);
+  char* args = strchr(msg, ' ');
+  if (args != nullptr)
+    *args++ = 0;
+  else
+    args = msg + strlen(msg);
+  CommandRoute* route = lastCommand;
+  while (route != nullptr && strcmp(route->name, msg) != 0)
+    route = route->next;
+  if (route == nullptr)
+    commandReply.print("unknown ");
+  commandReply.print(msg);
+  if (route != nullptr) {
+    commandReply.print(' ');
+    (*route->func)(args);
+  }
+  MsgBuf.saveMessage();
 }
 
 PushMsgDest::PushMsgDest(byte mask, char* host, int port, char* url, char* auth) :
@@ -262,36 +1083,49 @@ void PushMsgDest::doneSend(bool success) {
       _indexOut = 0;
     } else
       MsgBuf.removeMessages(_indexOut);
-    if (_parseBodyState != PBODY_STATE_DONE)
+    if (_parseBodyState != PBODY_STATE_DONE) {
       _indexIn = 0; // reset incoming index if message was not properly parsed
+    } else {
+      _indexIn = _indexParsed;
+      if (_indexIn != _indexRun) { // message is delivered again if its index was not acknowledged
+        _indexRun = _indexIn;
+        runCommand(_command);
+      }
+    }
     _wait = false; // no forced wait
+    _failures = 0;
     _period.reset(POLL_MSG_INTERVAL);
   } else {
     _wait = true;
-    _period.reset(RETRY_INTERVAL);
+    _period.reset(retryInterval());
   }
 }
 
-void PushMsgDest::printExtraUrlParams() {
-  client.print("?id=");
-  client.print(MESSAGE_OUT_ID);
-  client.print("&last=1");
+void PushMsgDest::printBody(BodyPrint& out) {
+  out.print(msgPacket);
+}
+
+void PushMsgDest::printExtraUrlParams(Print& out) {
+  out.print("?id=");
+  out.print(MESSAGE_OUT_ID);
+  out.print("&last=1");
   if (_indexIn > 0) {
-    client.print("&index=");
-    client.print(_indexIn, DEC);
+    out.print("&index=");
+    out.print(_indexIn, DEC);
   }
   if (_newSession)
-    client.print("&newsession1");
+    out.print("&newsession1");
   _parseCookieState = PCOOKIE_STATE_0;
   _parseBodyState = PBODY_STATE_0;
+  _commandSize = 0;
 }
 
-void PushMsgDest::printExtraHeaders() {
+void PushMsgDest::printExtraHeaders(Print& out) {
   if (_newSession || _cookie[0] == 0)
     return;
-  client.print(COOKIE);
-  client.print(_cookie);
-  client.println();
+  out.print(COOKIE);
+  out.print(_cookie);
+  out.println();
 }
 
 void PushMsgDest::parseResponseHeaders(char ch) {
@@ -327,23 +1161,23 @@ void PushMsgDest::parseResponseBody(char ch) {
     break;
   case PBODY_STATE_MSG:
     if (ch == ',') {
-      Serial.println();
+      _command[_commandSize] = 0;
       _parseBodyState = PBODY_STATE_WIDX;
-    } else
-      Serial.print(ch);
+    } else if (_commandSize < MAX_COMMAND_LEN)
+      _command[_commandSize++] = ch;
     break;
   case PBODY_STATE_WIDX:
     if (ch == ',') {
       _parseBodyState = PBODY_STATE_IDX;
-      _indexIn = 0;
+      _indexParsed = 0;
     }
     break;
   case PBODY_STATE_IDX:
     if (ch == '\r' || ch == '\n') {
-      _parseBodyState = PBODY_STATE_DONE;
+      _parseBodyState = PBODY_STATE_DONE; // command is run in doneSend, if status is OK
     } else if (ch >= '0' && ch <= '9') {
-      _indexIn *= 10;
-      _indexIn += ch - '0';
+      _indexParsed *= 10;
+      _indexParsed += ch - '0';
     } else
       _parseBodyState = PBODY_STATE_ERR;
     break;
@@ -351,15 +1185,13 @@ void PushMsgDest::parseResponseBody(char ch) {
 }
 
 void PushMsgDest::check() {
-  if (readResponse())
-    return;
-  if (clientBusy)
+  if (checkRequest())
     return;
   bool periodCheck = _period.check();
   if (_wait && !periodCheck)
     return; // we are in a 'forced wait' either on startup or after error
   msg_index_t index = 0;
-  int size = MsgBuf.encodeMessages(packet, MAX_PACKET, index);
+  int size = MsgBuf.encodeMessages(msgPacket, MAX_MSG_PACKET, index);
   // We return if we don't have outgoing message nor incoming messages to confirm nor periodic poll time
   if (size == 0 && _indexIn == 0 && !periodCheck)
     return;
@@ -367,30 +1199,151 @@ void PushMsgDest::check() {
     _newSession = true; // force new session for outgoing messages if index was reset
   if (_newSession) {
     // send empty message to create new session
-    size = 0;
-    packet[0] = 0;
+    msgPacket[0] = 0;
   } else
     _indexOut = index;
-  if (!sendPacket(size))
-    doneSend(false);
+  startSend();
 }
 
 void checkPush() {
+  checkDns();
+  PushDest::checkIdle();
   haworks_data.check();
-  //haworks_message.check(); // todo: upload messages, too
+  haworks_message.check();
+}
+
+void setPushInterval(long interval) {
+  pushInterval = interval;
+  for (PushDest* dest = lastDest; dest != nullptr; dest = dest->_next)
+    if ((dest->_mask & dataMasks) != 0 && dest->_failures == 0 && !dest->_sending && dest->_connectState == CONNECT_NONE)
+      dest->_period.reset(interval);
+}
+
+void setupPush() {
+  resetTagConfig();
+  for (PushId id = 0; id < PUSH_TAG_COUNT; id++)
+    pushItems[id].heartbeat.reset(0); // first value is always reported
+  PushDest::setupDests();
+}
+
+void resetTagConfig() {
+  PushTag tag;
+  for (PushId id = 0; id < PUSH_TAG_COUNT; id++) {
+    PushItem& item = pushItems[id];
+    loadTag(id, tag);
+    item.rate = tag.rate;
+    item.deadband = tag.deadband;
+    item.percent = tag.percent;
+  }
 }
 
-PushItem* pushTag(const char* tag) {
-  for (PushItem* cur = last_item; cur != nullptr; cur = cur->next) {
-    if (strcmp(cur->tag, tag) == 0) return cur;
+// tag is compared with line prefix H<tag>,
+PushId findTag(const char* tag) {
+  PushTag t;
+  uint8_t len = strlen(tag);
+  for (PushId id = 0; id < PUSH_TAG_COUNT; id++) {
+    loadTag(id, t);
+    if (t.len == len + 2 && strncmp(t.line + 1, tag, len) == 0)
+      return id;
   }
-  PushItem* item = new PushItem{last_item, tag};
-  last_item = item;
-  return item;
+  return PUSH_TAG_COUNT;
+}
+
+bool outsideDeadband(PushItem& item, int32_t val) {
+  int64_t d = abs((int64_t)val - item.reported);
+  if (item.percent)
+    return d * 100 > abs((int64_t)item.reported) * item.deadband;
+  return d > item.deadband;
 }
 
-void push(PushItem* item, int32_t val, byte prec) {
-  item->val = val;
-  item->prec = prec;
-  item->updated = MASK_ALL;
+// values are reported by exception: when they change beyond deadband or on heartbeat
+void push(PushId id, int32_t val, prec_t prec) {
+  PushItem& item = pushItems[id];
+  PushTag tag;
+  loadTag(id, tag);
+  val = convertPrec(val, prec, tag.prec);
+  item.val = val;
+  if (!item.heartbeat.check() && !(outsideDeadband(item, val) && item.hold.check()))
+    return;
+  const PushRate& rate = PUSH_RATES[item.rate];
+  item.reported = val;
+  item.time = millis();
+  item.updated = tag.mask;
+  item.hold.reset(rate.interval);
+  item.heartbeat.reset(rate.heartbeat);
+}
+
+void pushSeries(PushId id, PushSeries& series, int16_t* deltas, int32_t quantum, unsigned long interval, uint8_t capacity) {
+  series = PushSeries{interval, quantum, capacity};
+  series.deltas = deltas;
+  series.time = millis();
+  pushItems[id].series = &series;
+}
+
+void addSample(PushSeries* s) {
+  if (s->count == s->capacity)
+    dropSample(s); // not uploaded yet to some destination
+  int16_t d = SAMPLE_GAP;
+  if (s->n > 0) {
+    int32_t q = lround((float)s->sum / s->n / s->quantum);
+    int32_t wide = q - s->last; // the first sample is against 0
+    if ((wide < 1 - MAX_DELTA || wide > MAX_DELTA) && s->wideCount < SERIES_WIDE) {
+      d = SAMPLE_WIDE;
+      s->wide[s->wideCount++] = wide;
+    } else {
+      d = constrain(wide, 1 - MAX_DELTA, MAX_DELTA);
+    }
+    s->last += d == SAMPLE_WIDE ? wide : d;
+  }
+  s->deltas[(s->head + s->count) % s->capacity] = d;
+  s->count++;
+  s->sum = 0;
+  s->n = 0;
+}
+
+void pushSample(PushId id, int32_t val, prec_t prec, bool valid) {
+  PushSeries* s = pushItems[id].series;
+  if (s == nullptr) return;
+  unsigned long now = millis();
+  unsigned long span = s->interval * s->capacity;
+  if (now - s->time > span) {
+    s->n = 0;
+    s->time = now - span; // all kept samples are gaps
+  }
+  // close elapsed intervals
+  while (now - s->time >= s->interval) {
+    addSample(s);
+    s->time += s->interval;
+  }
+  if (!valid) return;
+  PushTag tag;
+  loadTag(id, tag);
+  s->sum += convertPrec(val, prec, tag.prec);
+  s->n++;
+}
+
+void setSeriesInterval(PushId id, unsigned long interval) {
+  PushSeries* s = pushItems[id].series;
+  if (s == nullptr) return;
+  s->interval = interval;
+  s->base = s->last;
+  s->head = 0;
+  s->count = 0;
+  memset(s->acked, 0, sizeof(s->acked));
+  memset(s->sending, 0, sizeof(s->sending));
+  s->wideCount = 0;
+  s->sum = 0;
+  s->n = 0;
+  s->time = millis();
+}
+
+void pushHistory(PushId id, int32_t val, prec_t prec, PushTime time) {
+  PushTag tag;
+  loadTag(id, tag);
+  if (historySize == HISTORY_SIZE) {
+    // drop the oldest record
+    memmove(history, history + 1, (HISTORY_SIZE - 1) * sizeof(PushRecord));
+    historySize--;
+  }
+  history[historySize++] = PushRecord{id, convertPrec(val, prec, tag.prec), time, tag.mask};
 }
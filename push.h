@@ -2,22 +2,99 @@
 #define PUSH_H_
 
 #include <Arduino.h>
+#include <Ethernet2.h>
+#include <EthernetClient.h>
 #include <Timeout.h>
 #include <FixNum.h>
 
 #include "msgbuf.h"
 
+// Upload formats of data destinations
+const uint8_t PUSH_CSV = 0;    // H<tag>,<value> lines
+const uint8_t PUSH_BINARY = 1; // tag dictionary & varint deltas, see tools/push_decode.py
+const uint8_t PUSH_DEFLATE = 0x10; // flag of format: body is compressed, see deflate.h
+
+// Default interval between uploads of data, pushInterval can be changed remotely
+const long NEXT_INTERVAL = 300000L; // 5min
+
+// Rate classes of pushed values
+const uint8_t PUSH_FAST = 0; // power & phase values, changes are reported on every send
+const uint8_t PUSH_SLOW = 1; // energy counters, changes are reported at most every 15 min
+
+const byte MASK_ALL = 0xff;
+const uint8_t MASK_BITS = 8; // each destination has its own bit of mask
+
+typedef uint16_t PushId; // index in PUSH_TAGS
+
+// Tag that is declared at compile time, see tags.h
+struct PushTag {
+  const char* line; // H<tag>, -- prefix of value line
+  uint8_t len;      // length of line prefix
+  prec_t prec;      // precision
+  uint8_t rate;     // rate class
+  int32_t deadband; // change of value that is reported, in units of precision or percent
+  bool percent;     // deadband is in percent of reported value
+  byte mask;        // destinations that receive tag
+};
+
+const uint8_t SERIES_WIDE = 4; // deltas of kept samples that do not fit int16, larger jumps are clamped
+
+// Samples of a value that are recorded at regular interval and uploaded together.
+// Values within interval are averaged and kept as deltas of quantized values.
+struct PushSeries {
+  unsigned long interval; // ms between samples
+  int32_t quantum;        // resolution of samples, in units of precision
+  uint8_t capacity;
+  uint8_t head;           // index of the oldest sample
+  uint8_t count;
+  uint8_t acked[MASK_BITS];   // oldest samples uploaded to destination, by bit of its mask
+  uint8_t sending[MASK_BITS]; // oldest samples up to the end of request being sent to destination
+  int32_t base;           // quantized value before the oldest sample
+  int32_t last;           // quantized value of the newest sample
+  unsigned long time;     // start of current interval
+  int64_t sum;            // sum of values in current interval
+  uint16_t n;             // number of values in current interval
+  int16_t* deltas;
+  int32_t wide[SERIES_WIDE]; // deltas of SAMPLE_WIDE samples, from the oldest one
+  uint8_t wideCount;
+};
+
+// state of a tag
 struct PushItem {
-  PushItem* next;
-  const char* tag;
-  int32_t val;    // value
-  prec_t prec;    // precision
+  int32_t val;      // value
   byte updated;
   byte sending;
+  uint8_t rate;     // rate class, initially from PushTag
+  int32_t deadband; // initially from PushTag
+  bool percent;     // initially from PushTag
+  int32_t reported; // last reported value
+  unsigned long time; // when value was reported
+  Timeout hold;     // when changed value can be reported again
+  Timeout heartbeat; // when value is reported even if it did not change
+  PushSeries* series; // samples of value, nullptr -- not recorded
+  int32_t acked;    // value acknowledged by binary destination, deltas are sent against it, only one is supported
+  int32_t sent;     // value in the request being sent to binary destination
+};
+
+// time of a history value, as kept by the meter
+struct PushTime {
+  uint8_t year;
+  uint8_t month;
+  uint8_t date;
+  uint8_t hour;
+  uint8_t minute;
 };
 
+class PushQueue;
+class BodyPrint;
+
+const int MAX_RESPONSE = 300;
+const int MAX_HEADER = 40;
+
+// Each destination owns its connection, so a slow server delays only its own uploads
 class PushDest {
 protected:
+  PushDest* _next; // list of all destinations
   byte _mask;
   const char* _host;
   int _port;
@@ -28,24 +105,65 @@ protected:
   Timeout _period;
   Timeout _timeout;
 
-  bool _next;
   bool _sending;
+  bool _reused; // request was sent over kept alive connection
+  uint8_t _format;
+  bool _deflate; // body is compressed until server rejects it
+  bool _session; // binary session is established, server knows dictionary and acked values
+  PushQueue* _queue; // values that failed to upload, nullptr -- only the latest values are sent
+  bool _more; // request was full, the rest is sent soon
+  uint8_t _failures; // failed requests in a row
+
+  EthernetClient _client;
+  bool _connected; // socket is taken by connection to _host
+  Timeout _idle;   // when kept alive connection is closed
+  uint8_t _connectState;
+  Timeout _connectTimeout;
+  IPAddress _ip;   // resolved address of _host
+  uint8_t _sock;   // socket that is being connected
 
-  bool sendPacket(byte size);
+  int _responsePart;
+  int _responseSize;
+  char _response[MAX_RESPONSE + 1];
+  int _headerSize;
+  char _header[MAX_HEADER + 1]; // current response header line
+  long _contentLength; // -1 -- not known, response ends when connection is closed
+  long _bodySize;
+  bool _keepAlive; // server keeps connection open after response
+
+  bool openSocket();
+  void connectFailed(const char* reason);
+  void checkConnect();
+  void startSend();
+  bool checkRequest();
+  void closeClient();
+  bool closeIdle();
+  void parseHeader();
+  bool responseDone();
+  void sendPacket();
   void parseChar(char ch);
   bool readResponse();
+  long retryInterval();
 
   virtual void doneSend(bool success);
-  virtual void printExtraUrlParams() {}
-  virtual void printExtraHeaders() {}
+  virtual void printBody(BodyPrint& out);
+  bool printContent(Print& out, long limit);
+  void printHeaders(Print& out, long size);
+  virtual void printExtraUrlParams(Print& out) {}
+  virtual void printExtraHeaders(Print& out) {}
   virtual void parseResponseHeaders(char ch) {}
   virtual void parseResponseBody(char ch) {}
+
+  friend void setPushInterval(long interval);
 public:
-  PushDest(byte mask, char* host, int port, char* url, char* auth);
+  PushDest(byte mask, char* host, int port, char* url, char* auth, uint8_t format = PUSH_CSV, PushQueue* queue = nullptr);
   void check();
+  static void checkIdle(); // closes idle connections of all destinations
+  static void setupDests(); // begins queues, disables binary destinations but the first one
 };
 
 const long MAX_COOKIE_LEN = 20;
+const int MAX_COMMAND_LEN = 40;
 
 class PushMsgDest : PushDest {
 protected:
@@ -55,10 +173,15 @@ protected:
   char _cookie[MAX_COOKIE_LEN + 1];
   byte _parseCookieState; // Parse Set-Cookie response header
   byte _parseBodyState; // Parse response messages from body
+  char _command[MAX_COMMAND_LEN + 1]; // inbound message
+  uint8_t _commandSize;
+  long _indexParsed; // index of inbound message in response body, taken only from successful response
+  long _indexRun; // index of the last inbound message that was run as command
   bool _wait;
   virtual void doneSend(bool success);
-  virtual void printExtraUrlParams();
-  virtual void printExtraHeaders();
+  virtual void printBody(BodyPrint& out);
+  virtual void printExtraUrlParams(Print& out);
+  virtual void printExtraHeaders(Print& out);
   virtual void parseResponseHeaders(char ch);
   virtual void parseResponseBody(char ch);
 public:
@@ -70,12 +193,40 @@ public:
 extern PushDest haworks_data;
 extern PushMsgDest haworks_message;
 
-PushItem* pushTag(const char* tag);
-void push(PushItem* item, int32_t val, prec_t prec);
+// declared in tags.cpp
+extern const PushTag PUSH_TAGS[];
+extern const PushId PUSH_TAG_COUNT;
+extern PushItem pushItems[];
+
+// values are converted to precision of their tags
+void setupPush();
+void resetTagConfig(); // rate & deadband of each tag as declared in PUSH_TAGS
+PushId findTag(const char* tag); // PUSH_TAG_COUNT if not found
+void push(PushId id, int32_t val, prec_t prec);
+void pushHistory(PushId id, int32_t val, prec_t prec, PushTime time);
+void pushSeries(PushId id, PushSeries& series, int16_t* deltas, int32_t quantum, unsigned long interval, uint8_t capacity);
+void pushSample(PushId id, int32_t val, prec_t prec, bool valid); // invalid values leave gap if there are no others in interval
+void setSeriesInterval(PushId id, unsigned long interval); // kept samples are dropped
 void checkPush();
 
-template<typename T, prec_t prec> void push(PushItem* item, FixNum<T, prec> val) {
-    push(item, val.mantissa(), prec);
+extern long pushInterval; // between uploads of data, changed remotely
+void setPushInterval(long interval); // data destinations that wait longer are due sooner
+
+// Inbound messages are commands: the first word is command name, the rest are its arguments.
+// Reply is sent back as outbound message "<name> <what func prints to commandReply>".
+void pushCommandRoute(char* name, void (*func)(char* args));
+extern Print& commandReply;
+
+template<typename T, prec_t prec> void push(PushId id, FixNum<T, prec> val) {
+    push(id, val.mantissa(), prec);
+}
+
+template<typename T, prec_t prec> void pushSample(PushId id, FixNum<T, prec> val, bool valid) {
+    pushSample(id, val.mantissa(), prec, valid);
+}
+
+template<typename T, prec_t prec> void pushHistory(PushId id, FixNum<T, prec> val, PushTime time) {
+    pushHistory(id, val.mantissa(), prec, time);
 }
 
 #endif
@@ -0,0 +1,177 @@
+#include <Arduino.h>
+#include <SD.h>
+
+#include "queue.h"
+
+#ifndef ARDUINO
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#define log SerialUSB
+
+bool SdQueueStore::begin() {
+  if (!SD.begin(_csPin)) {
+    log.println("SD: not found");
+    return false;
+  }
+  // not FILE_WRITE, it appends every write to the end of file
+  _file = SD.open(_path, O_READ | O_WRITE | O_CREAT);
+  if (!_file) {
+    log.print(_path);
+    log.println(": failed to open");
+    return false;
+  }
+  // file is allocated upfront, so that any slot can be written
+  const uint8_t zero[sizeof(QueueRecord)] = {};
+  uint32_t size = sizeof(QueueHeader) + (uint32_t)_capacity * sizeof(QueueRecord);
+  _file.seek(_file.size());
+  while (_file.size() < size)
+    _file.write(zero, min(size - _file.size(), sizeof(zero)));
+  _file.flush();
+  return true;
+}
+
+bool SdQueueStore::seek(uint16_t slot) {
+  return _file.seek(sizeof(QueueHeader) + (uint32_t)slot * sizeof(QueueRecord));
+}
+
+void SdQueueStore::read(uint16_t slot, QueueRecord& rec) {
+  if (!seek(slot) || _file.read((uint8_t*)&rec, sizeof(QueueRecord)) != sizeof(QueueRecord))
+    rec = QueueRecord{};
+}
+
+void SdQueueStore::write(uint16_t slot, const QueueRecord& rec) {
+  if (seek(slot))
+    _file.write((const uint8_t*)&rec, sizeof(QueueRecord));
+}
+
+bool SdQueueStore::readHeader(QueueHeader& header) {
+  return _file.seek(0) && _file.read((uint8_t*)&header, sizeof(QueueHeader)) == sizeof(QueueHeader);
+}
+
+// header is written after records it counts, flush makes both survive power loss
+void SdQueueStore::writeHeader(const QueueHeader& header) {
+  if (_file.seek(0))
+    _file.write((const uint8_t*)&header, sizeof(QueueHeader));
+  _file.flush();
+}
+
+#ifndef ARDUINO
+PosixQueueStore::~PosixQueueStore() {
+  if (_fd >= 0)
+    close(_fd);
+}
+
+bool PosixQueueStore::begin() {
+  if (_fd >= 0)
+    close(_fd);
+  _fd = open(_path, O_RDWR | O_CREAT, 0644);
+  if (_fd < 0) {
+    log.print(_path);
+    log.println(": failed to open");
+    return false;
+  }
+  // file is allocated upfront, like on SD card
+  off_t size = sizeof(QueueHeader) + (off_t)_capacity * sizeof(QueueRecord);
+  return lseek(_fd, 0, SEEK_END) >= size || ftruncate(_fd, size) == 0;
+}
+
+static off_t slotOffset(uint16_t slot) {
+  return sizeof(QueueHeader) + (off_t)slot * sizeof(QueueRecord);
+}
+
+void PosixQueueStore::read(uint16_t slot, QueueRecord& rec) {
+  if (pread(_fd, &rec, sizeof(QueueRecord), slotOffset(slot)) != sizeof(QueueRecord))
+    rec = QueueRecord{};
+}
+
+void PosixQueueStore::write(uint16_t slot, const QueueRecord& rec) {
+  if (pwrite(_fd, &rec, sizeof(QueueRecord), slotOffset(slot)) != sizeof(QueueRecord))
+    log.println("queue: write failed");
+}
+
+bool PosixQueueStore::readHeader(QueueHeader& header) {
+  return pread(_fd, &header, sizeof(QueueHeader), 0) == sizeof(QueueHeader);
+}
+
+void PosixQueueStore::writeHeader(const QueueHeader& header) {
+  if (pwrite(_fd, &header, sizeof(QueueHeader), 0) != sizeof(QueueHeader))
+    log.println("queue: write failed");
+}
+#endif
+
+// records kept by store are restored, queue time goes on from when they were saved
+void PushQueue::begin() {
+  _capacity = _store.begin() ? _store.capacity() : 0;
+  _head = 0;
+  _count = 0;
+  _sending = 0;
+  _offset = 0;
+  QueueHeader header;
+  if (_capacity > 0 && _store.readHeader(header) && header.magic == QUEUE_MAGIC && header.capacity == _capacity &&
+      header.head < _capacity && header.count <= _capacity) {
+    _head = header.head;
+    _count = header.count;
+    _offset = header.clock - millis();
+  }
+  if (_count > 0) {
+    log.print("queue: ");
+    log.print(_count);
+    log.println(" records restored");
+  }
+}
+
+void PushQueue::save() {
+  _store.writeHeader(QueueHeader{QUEUE_MAGIC, _capacity, _head, _count, millis() + _offset});
+}
+
+void PushQueue::peek(uint16_t i, QueueRecord& rec) {
+  _store.read((_head + i) % _capacity, rec);
+  rec.time -= _offset;
+}
+
+// records before the dropped one are moved by one slot towards tail
+void PushQueue::evict() {
+  uint16_t drop = 0;
+  if (_evict == EVICT_PRIORITY) {
+    QueueRecord rec;
+    for (uint16_t i = 0; i < _count; i++) {
+      _store.read((_head + i) % _capacity, rec);
+      if (pushItems[rec.id].rate == PUSH_FAST) {
+        drop = i;
+        break;
+      }
+    }
+  }
+  QueueRecord rec;
+  for (uint16_t i = drop; i > 0; i--) {
+    _store.read((_head + i - 1) % _capacity, rec);
+    _store.write((_head + i) % _capacity, rec);
+  }
+  _head = (_head + 1) % _capacity;
+  _count--;
+  if (drop < _sending)
+    _sending--;
+}
+
+void PushQueue::add(const QueueRecord& rec) {
+  if (_capacity == 0)
+    return;
+  if (_count == _capacity)
+    evict();
+  QueueRecord stored = rec;
+  stored.time += _offset;
+  _store.write((_head + _count) % _capacity, stored);
+  _count++;
+  save();
+}
+
+void PushQueue::doneSend(bool success) {
+  if (success && _sending > 0) {
+    _head = (_head + _sending) % _capacity;
+    _count -= _sending;
+    save();
+  }
+  _sending = 0;
+}
@@ -0,0 +1,117 @@
+#ifndef QUEUE_H_
+#define QUEUE_H_
+
+#include <Arduino.h>
+#include <SD.h>
+
+#include "push.h"
+
+// Reported values that failed to upload are queued and sent later with the time they were reported.
+// File stores keep the queue over reset. Record times are millis, so restored records keep their order and spacing,
+// but the time from the last change of queue to restart is lost.
+
+struct QueueRecord {
+  PushId id;
+  int32_t val;
+  unsigned long time; // when value was reported
+};
+
+// Queue state saved in front of file slots
+struct QueueHeader {
+  uint32_t magic;
+  uint16_t capacity;
+  uint16_t head;
+  uint16_t count;
+  unsigned long clock; // queue time when saved
+};
+
+const uint32_t QUEUE_MAGIC = 0x51554531; // "QUE1"
+
+// Storage of a fixed number of record slots
+class QueueStore {
+public:
+  virtual bool begin() = 0; // false -- storage is not available
+  virtual uint16_t capacity() = 0;
+  virtual void read(uint16_t slot, QueueRecord& rec) = 0;
+  virtual void write(uint16_t slot, const QueueRecord& rec) = 0;
+  virtual bool readHeader(QueueHeader& header) { return false; } // false -- state is not kept
+  virtual void writeHeader(const QueueHeader& header) {}
+};
+
+// Slots in RAM
+class RamQueueStore : public QueueStore {
+private:
+  QueueRecord* _slots;
+  uint16_t _capacity;
+public:
+  RamQueueStore(QueueRecord* slots, uint16_t capacity) : _slots(slots), _capacity(capacity) {}
+  virtual bool begin() { return true; }
+  virtual uint16_t capacity() { return _capacity; }
+  virtual void read(uint16_t slot, QueueRecord& rec) { rec = _slots[slot]; }
+  virtual void write(uint16_t slot, const QueueRecord& rec) { _slots[slot] = rec; }
+};
+
+// Slots in a file on SD card, for outages that RAM cannot cover
+class SdQueueStore : public QueueStore {
+private:
+  uint8_t _csPin;
+  const char* _path;
+  uint16_t _capacity;
+  File _file;
+  bool seek(uint16_t slot);
+public:
+  SdQueueStore(uint8_t csPin, const char* path, uint16_t capacity) : _csPin(csPin), _path(path), _capacity(capacity) {}
+  virtual bool begin();
+  virtual uint16_t capacity() { return _capacity; }
+  virtual void read(uint16_t slot, QueueRecord& rec);
+  virtual void write(uint16_t slot, const QueueRecord& rec);
+  virtual bool readHeader(QueueHeader& header);
+  virtual void writeHeader(const QueueHeader& header);
+};
+
+#ifndef ARDUINO
+// Slots in a file of host file system, for host tests
+class PosixQueueStore : public QueueStore {
+private:
+  const char* _path;
+  uint16_t _capacity;
+  int _fd = -1;
+public:
+  PosixQueueStore(const char* path, uint16_t capacity) : _path(path), _capacity(capacity) {}
+  ~PosixQueueStore();
+  virtual bool begin();
+  virtual uint16_t capacity() { return _capacity; }
+  virtual void read(uint16_t slot, QueueRecord& rec);
+  virtual void write(uint16_t slot, const QueueRecord& rec);
+  virtual bool readHeader(QueueHeader& header);
+  virtual void writeHeader(const QueueHeader& header);
+};
+#endif
+
+// Eviction policies of full queue
+const uint8_t EVICT_OLDEST = 0;   // the oldest record is dropped
+const uint8_t EVICT_PRIORITY = 1; // the oldest record of PUSH_FAST tags is dropped before PUSH_SLOW ones
+
+// Ring of records over storage slots
+class PushQueue {
+private:
+  QueueStore& _store;
+  uint8_t _evict;
+  uint16_t _capacity; // 0 -- storage is not available
+  uint16_t _head;
+  uint16_t _count;
+  uint16_t _sending; // the oldest records in the request being sent
+  unsigned long _offset; // queue time - millis, queue time goes on from where it was before reset
+  void evict();
+  void save();
+public:
+  PushQueue(QueueStore& store, uint8_t evict = EVICT_OLDEST) : _store(store), _evict(evict) {}
+  void begin();
+  uint16_t count() { return _count; }
+  void add(const QueueRecord& rec);
+  void peek(uint16_t i, QueueRecord& rec); // i-th oldest record
+  void startSend(uint16_t n) { _sending = n; }
+  void doneSend(bool success);
+};
+
+#endif
@@ -0,0 +1,14 @@
+#include <avr/pgmspace.h>
+
+#include "tags.h"
+
+#define TAG_DESC(p, id, s, prec, rate, db, pct) { "H" p s ",", sizeof("H" p s ",") - 1, prec, rate, db, pct, MASK_ALL },
+#define METER_TAG_DESCS(p) METER_TAGS(TAG_DESC, p)
+
+const PushTag PUSH_TAGS[] PROGMEM = {
+  METER_PREFIXES(METER_TAG_DESCS)
+};
+
+const PushId PUSH_TAG_COUNT = sizeof(PUSH_TAGS) / sizeof(PushTag);
+
+PushItem pushItems[sizeof(PUSH_TAGS) / sizeof(PushTag)];
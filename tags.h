@@ -0,0 +1,81 @@
+#ifndef TAGS_H_
+#define TAGS_H_
+
+#include <Arduino.h>
+
+#include "Mercury.h"
+#include "push.h"
+
+// Pushed tags are declared here, PUSH_TAGS table is generated from them at compile time
+
+// changes of aggregated values that are pushed
+const int32_t VOLTS_DEADBAND = 10; // 1.0 V
+const int32_t HERTZ_DEADBAND = 1; // 0.1 Hz
+const int32_t IMBALANCE_DEADBAND = 10; // 1.0 %
+const int32_t POWER_DEADBAND = 2; // 2 % of watts, amps & VA
+
+// tag prefix of each meter, in the order of meter addresses in Mercury.cpp
+#define METER_PREFIXES(M) \
+  M("E")
+
+// mean, min, max and standard deviation over aggregation window, with extra 'n', 'x' and 'd' suffix
+#define AGG_TAGS(X, p, id, s, db, pct) \
+  X(p, id,      s,     1, PUSH_FAST, db, pct) \
+  X(p, id##_MIN, s "n", 1, PUSH_FAST, db, pct) \
+  X(p, id##_MAX, s "x", 1, PUSH_FAST, db, pct) \
+  X(p, id##_DEV, s "d", 1, PUSH_FAST, db, pct)
+
+// tags of phase i, all phases have the same layout
+#define PHASE_TAGS(X, p, i) \
+  AGG_TAGS(X, p, WATTS_##i,    #i,     POWER_DEADBAND, true) \
+  AGG_TAGS(X, p, VOLTS_##i,    #i "v", VOLTS_DEADBAND, false) \
+  AGG_TAGS(X, p, AMPS_##i,     #i "a", POWER_DEADBAND, true) \
+  AGG_TAGS(X, p, APPARENT_##i, #i "s", POWER_DEADBAND, true) \
+  X(p, WATTS_SAMPLES_##i, #i "w", 1, PUSH_FAST, 0, false)
+
+// tags of a meter with prefix p: X(p, id, suffix, prec, rate, deadband, percent)
+#define METER_TAGS(X, p) \
+  AGG_TAGS(X, p, HERTZ,     "f", HERTZ_DEADBAND, false) \
+  AGG_TAGS(X, p, IMBALANCE, "u", IMBALANCE_DEADBAND, false) \
+  AGG_TAGS(X, p, WATTS_0,   "",  POWER_DEADBAND, true) \
+  X(p, WATTS_SAMPLES_0, "w", 1, PUSH_FAST, 0, false) \
+  PHASE_TAGS(X, p, 1) \
+  PHASE_TAGS(X, p, 2) \
+  PHASE_TAGS(X, p, 3) \
+  X(p, CUR_DAY_0,  "c",  3, PUSH_SLOW, 0, false) \
+  X(p, CUR_DAY_1,  "1c", 3, PUSH_SLOW, 0, false) \
+  X(p, CUR_DAY_2,  "2c", 3, PUSH_SLOW, 0, false) \
+  X(p, PREV_DAY_0, "p",  3, PUSH_SLOW, 0, false) \
+  X(p, PREV_DAY_1, "1p", 3, PUSH_SLOW, 0, false) \
+  X(p, PREV_DAY_2, "2p", 3, PUSH_SLOW, 0, false) \
+  X(p, PROFILE,    "l",  1, PUSH_FAST, 0, false)
+
+#define TAG_ENUM(p, id, s, prec, rate, db, pct) T_##id,
+
+// tags of each meter
+enum MeterTag {
+  METER_TAGS(TAG_ENUM, "")
+  METER_TAGS_COUNT
+};
+
+#define COUNT_METER(p) + 1
+static_assert(0 METER_PREFIXES(COUNT_METER) == METERS, "METER_PREFIXES lists prefix of each meter");
+static_assert(TARIFFS == 2, "METER_TAGS lists energy tags for each tariff");
+
+// tags of meters follow each other in PUSH_TAGS
+inline PushId meterTag(uint8_t m, int t) {
+  return m * METER_TAGS_COUNT + t;
+}
+
+// tag t of phase 1 in phase i
+inline PushId phaseTag(uint8_t m, uint8_t i, int t) {
+  return meterTag(m, t + (i - 1) * (T_WATTS_2 - T_WATTS_1));
+}
+
+// offsets of aggregates from the first tag of AGG_TAGS
+const uint8_t AGG_MEAN = 0;
+const uint8_t AGG_MIN = 1;
+const uint8_t AGG_MAX = 2;
+const uint8_t AGG_DEV = 3;
+
+#endif
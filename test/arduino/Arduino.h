@@ -0,0 +1,94 @@
+#ifndef ARDUINO_H_
+#define ARDUINO_H_
+
+// Host shim of the parts of Arduino core that sketch modules use, see host.h for simulated clock
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <math.h>
+#include <type_traits>
+#include <avr/pgmspace.h>
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define DEC 10
+#define HEX 16
+#define LOW 0
+#define HIGH 1
+#define INPUT 0
+#define OUTPUT 1
+
+// by value, like the macros of Arduino core
+template<typename A, typename B> auto min(A a, B b) -> typename std::decay<decltype(a < b ? a : b)>::type {
+  return a < b ? a : b;
+}
+template<typename A, typename B> auto max(A a, B b) -> typename std::decay<decltype(a > b ? a : b)>::type {
+  return a > b ? a : b;
+}
+#define constrain(x, low, high) ((x) < (low) ? (low) : ((x) > (high) ? (high) : (x)))
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+
+long random(long howbig);
+long random(long howsmall, long howbig);
+void randomSeed(unsigned long seed);
+
+class Print {
+private:
+  size_t printNumber(unsigned long n, uint8_t base);
+  size_t printFloat(double number, uint8_t digits);
+public:
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t* buf, size_t size);
+  size_t write(const char* str) { return str == nullptr ? 0 : write((const uint8_t*)str, strlen(str)); }
+  size_t write(const char* buf, size_t size) { return write((const uint8_t*)buf, size); }
+  virtual void flush() {}
+
+  size_t print(const char* s) { return write(s); }
+  size_t print(char c) { return write((uint8_t)c); }
+  size_t print(unsigned char n, int base = DEC) { return print((unsigned long)n, base); }
+  size_t print(int n, int base = DEC) { return print((long)n, base); }
+  size_t print(unsigned int n, int base = DEC) { return print((unsigned long)n, base); }
+  size_t print(long n, int base = DEC);
+  size_t print(unsigned long n, int base = DEC);
+  size_t print(double n, int digits = 2) { return printFloat(n, digits); }
+
+  size_t println() { return write("\r\n"); }
+  template<typename T> size_t println(T x) { size_t n = print(x); return n + println(); }
+  template<typename T> size_t println(T x, int f) { size_t n = print(x, f); return n + println(); }
+};
+
+class Stream : public Print {
+public:
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual int peek() = 0;
+};
+
+// console output goes to stdout
+class HostSerial : public Stream {
+public:
+  void begin(long baud) {}
+  void end() {}
+  virtual int available() { return 0; }
+  virtual int read() { return -1; }
+  virtual int peek() { return -1; }
+  int availableForWrite() { return 64; }
+  virtual size_t write(uint8_t c);
+  using Print::write;
+  operator bool() { return true; }
+};
+
+extern HostSerial Serial;
+extern HostSerial SerialUSB;
+
+#endif
@@ -0,0 +1,19 @@
+#ifndef ETHERNET2_H_
+#define ETHERNET2_H_
+
+// Host shim of Ethernet2 library over fake W5500 sockets, see host.h
+
+#include <Arduino.h>
+#include <IPAddress.h>
+#include <EthernetClient.h>
+#include <utility/w5500.h>
+
+class EthernetClass {
+public:
+  IPAddress localIP() { return IPAddress(10, 0, 0, 2); }
+  IPAddress dnsServerIP() { return IPAddress(10, 0, 0, 1); }
+};
+
+extern EthernetClass Ethernet;
+
+#endif
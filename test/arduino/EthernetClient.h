@@ -0,0 +1,27 @@
+#ifndef ETHERNETCLIENT_H_
+#define ETHERNETCLIENT_H_
+
+#include <Arduino.h>
+#include <IPAddress.h>
+#include <utility/w5500.h>
+
+class EthernetClient : public Stream {
+private:
+  uint8_t _sock;
+public:
+  EthernetClient() : _sock(MAX_SOCK_NUM) {}
+  EthernetClient(uint8_t sock) : _sock(sock) {}
+  uint8_t connected();
+  virtual int available();
+  virtual int read();
+  virtual int peek();
+  virtual size_t write(uint8_t c) { return write(&c, 1); }
+  virtual size_t write(const uint8_t* buf, size_t size);
+  using Print::write;
+  virtual void flush() {}
+  void stop();
+  uint8_t getSocketNumber() { return _sock; }
+  operator bool() { return _sock != MAX_SOCK_NUM; }
+};
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef ETHERNETUDP2_H_
+#define ETHERNETUDP2_H_
+
+#include <string>
+
+#include <Arduino.h>
+#include <IPAddress.h>
+
+// packets go through hostUdpSent & hostUdpReceived, server side is played by test, see host.h
+class EthernetUDP : public Stream {
+private:
+  bool _open = false;
+  IPAddress _txIp;
+  uint16_t _txPort = 0;
+  std::string _tx;
+  IPAddress _rxIp;
+  uint16_t _rxPort = 0;
+  std::string _rx;
+  size_t _rxPos = 0;
+public:
+  uint8_t begin(uint16_t port);
+  void stop();
+  int beginPacket(IPAddress ip, uint16_t port);
+  int endPacket();
+  int parsePacket(); // the next received packet, the rest of current one is dropped
+  IPAddress remoteIP() { return _rxIp; }
+  uint16_t remotePort() { return _rxPort; }
+  virtual size_t write(uint8_t c);
+  using Print::write;
+  virtual int available() { return _rx.size() - _rxPos; }
+  virtual int read() { return _rxPos < _rx.size() ? (uint8_t)_rx[_rxPos++] : -1; }
+  virtual int peek() { return _rxPos < _rx.size() ? (uint8_t)_rx[_rxPos] : -1; }
+};
+
+#endif
@@ -0,0 +1,34 @@
+#include <FixNum.h>
+
+uint8_t formatDecimal(int32_t x, char* pos, uint8_t size, uint8_t fmt) {
+  uint8_t prec = fmt & FMT_PREC;
+  bool pad = (fmt & (FMT_RIGHT | FMT_ZERO)) != 0;
+  uint32_t v = x < 0 ? -(uint32_t)x : x;
+  char digits[16];
+  uint8_t n = 0;
+  do {
+    digits[n++] = '0' + v % 10;
+    v /= 10;
+  } while (v > 0 || n <= prec);
+  char sign = x < 0 ? '-' : (fmt & FMT_SIGN) ? '+' : 0;
+  uint8_t len = n + (prec > 0) + (sign != 0);
+  if (len > size) {
+    memset(pos, '#', size);
+    return size;
+  }
+  uint8_t i = 0;
+  if (pad && (fmt & FMT_ZERO) == 0)
+    for (; i < size - len; i++)
+      pos[i] = ' ';
+  if (sign != 0)
+    pos[i++] = sign;
+  if (pad && (fmt & FMT_ZERO) != 0)
+    for (uint8_t k = 0; k < size - len; k++)
+      pos[i++] = '0';
+  while (n > 0) {
+    if (n == prec)
+      pos[i++] = '.';
+    pos[i++] = digits[--n];
+  }
+  return i;
+}
@@ -0,0 +1,44 @@
+#ifndef FIXNUM_H_
+#define FIXNUM_H_
+
+#include <Arduino.h>
+
+// Host shim of FixNum library: decimal fixed point numbers and their formatting
+
+typedef uint8_t prec_t;
+
+const uint8_t FMT_PREC = 0x0f;  // precision in low bits of format
+const uint8_t FMT_RIGHT = 0x10; // right-aligned in the given size, padded with spaces
+const uint8_t FMT_ZERO = 0x20;  // right-aligned in the given size, padded with zeros
+const uint8_t FMT_SIGN = 0x40;  // sign of positive numbers, too
+
+// formats x with (fmt & FMT_PREC) digits after point, returns number of chars written,
+// number that does not fit into size is shown as #
+uint8_t formatDecimal(int32_t x, char* pos, uint8_t size, uint8_t fmt);
+
+template<typename T, prec_t prec> class FixNum {
+private:
+  T _mantissa;
+public:
+  FixNum() : _mantissa(0) {}
+  explicit FixNum(T mantissa) : _mantissa(mantissa) {}
+
+  // converts to this precision
+  template<prec_t from> FixNum(FixNum<T, from> x) {
+    T m = x.mantissa();
+    for (prec_t p = from; p < prec; p++) m *= 10;
+    for (prec_t p = from; p > prec; p--) m /= 10;
+    _mantissa = m;
+  }
+
+  T mantissa() const { return _mantissa; }
+  uint8_t format(char* pos, uint8_t size, uint8_t fmt) { return formatDecimal(_mantissa, pos, size, (fmt & ~FMT_PREC) | prec); }
+  bool operator==(FixNum x) const { return _mantissa == x._mantissa; }
+  bool operator!=(FixNum x) const { return _mantissa != x._mantissa; }
+};
+
+typedef FixNum<int32_t, 1> fixnum32_1;
+typedef FixNum<int32_t, 2> fixnum32_2;
+typedef FixNum<int32_t, 3> fixnum32_3;
+
+#endif
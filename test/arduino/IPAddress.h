@@ -0,0 +1,18 @@
+#ifndef IPADDRESS_H_
+#define IPADDRESS_H_
+
+#include <Arduino.h>
+
+class IPAddress {
+private:
+  uint8_t _addr[4];
+public:
+  IPAddress() : _addr{0, 0, 0, 0} {}
+  IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) : _addr{a, b, c, d} {}
+  bool fromString(const char* s);
+  uint8_t operator[](int i) const { return _addr[i]; }
+  uint8_t& operator[](int i) { return _addr[i]; }
+  operator uint32_t() const { return _addr[0] | (_addr[1] << 8) | (_addr[2] << 16) | ((uint32_t)_addr[3] << 24); }
+};
+
+#endif
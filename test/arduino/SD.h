@@ -0,0 +1,34 @@
+#ifndef SD_H_
+#define SD_H_
+
+#include <Arduino.h>
+
+// Host shim of SD library: there is no card, see PosixQueueStore in queue.h for files on host
+
+#define O_READ 0x01
+#define O_WRITE 0x02
+#define O_CREAT 0x40
+
+class File : public Stream {
+public:
+  virtual size_t write(uint8_t c) { return 0; }
+  using Print::write;
+  virtual int available() { return 0; }
+  virtual int read() { return -1; }
+  int read(void* buf, uint16_t n) { return -1; }
+  virtual int peek() { return -1; }
+  bool seek(uint32_t pos) { return false; }
+  uint32_t size() { return 0; }
+  void close() {}
+  operator bool() { return false; }
+};
+
+class SDClass {
+public:
+  bool begin(uint8_t csPin) { return false; }
+  File open(const char* path, uint8_t mode) { return File(); }
+};
+
+extern SDClass SD;
+
+#endif
@@ -0,0 +1,36 @@
+#ifndef TIMEOUT_H_
+#define TIMEOUT_H_
+
+#include <Arduino.h>
+
+// Host shim of Timeout library: fires once on check() after interval elapses, default one is disabled
+
+class Timeout {
+private:
+  bool _enabled;
+  unsigned long _time;
+public:
+  static const unsigned long SECOND = 1000UL;
+  static const unsigned long MINUTE = 60 * SECOND;
+  static const unsigned long HOUR = 60 * MINUTE;
+  static const unsigned long DAY = 24 * HOUR;
+
+  Timeout() : _enabled(false), _time(0) {}
+  Timeout(unsigned long interval) { reset(interval); }
+
+  bool enabled() { return _enabled; }
+
+  void reset(unsigned long interval) {
+    _enabled = true;
+    _time = millis() + interval;
+  }
+
+  bool check() {
+    if (!_enabled || (long)(millis() - _time) < 0)
+      return false;
+    _enabled = false;
+    return true;
+  }
+};
+
+#endif
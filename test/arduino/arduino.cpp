@@ -0,0 +1,110 @@
+#include <stdio.h>
+
+#include <Arduino.h>
+#include <IPAddress.h>
+
+#include "host.h"
+
+HostSerial Serial;
+HostSerial SerialUSB;
+
+//------- TIME ------
+
+unsigned long hostMicros;
+
+void hostAdvance(unsigned long us) {
+  hostMicros += us;
+}
+
+unsigned long micros() {
+  return hostMicros;
+}
+
+unsigned long millis() {
+  return hostMicros / 1000;
+}
+
+void delay(unsigned long ms) {
+  hostAdvance(ms * 1000);
+}
+
+//------- PINS ------
+
+void pinMode(uint8_t pin, uint8_t mode) {}
+void digitalWrite(uint8_t pin, uint8_t val) {}
+
+//------- RANDOM ------
+
+long random(long howbig) {
+  return howbig <= 0 ? 0 : ::random() % howbig;
+}
+
+long random(long howsmall, long howbig) {
+  return howsmall >= howbig ? howsmall : howsmall + random(howbig - howsmall);
+}
+
+void randomSeed(unsigned long seed) {
+  srandom(seed);
+}
+
+//------- PRINT ------
+
+size_t Print::write(const uint8_t* buf, size_t size) {
+  size_t n = 0;
+  while (size-- > 0)
+    n += write(*buf++);
+  return n;
+}
+
+size_t Print::printNumber(unsigned long n, uint8_t base) {
+  char buf[8 * sizeof(long) + 1];
+  char* s = buf + sizeof(buf) - 1;
+  *s = 0;
+  do {
+    char c = n % base;
+    n /= base;
+    *--s = c < 10 ? c + '0' : c + 'A' - 10;
+  } while (n > 0);
+  return write(s);
+}
+
+size_t Print::printFloat(double number, uint8_t digits) {
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%.*f", digits, number);
+  return write(buf);
+}
+
+size_t Print::print(long n, int base) {
+  if (base == DEC && n < 0)
+    return print('-') + printNumber(-(unsigned long)n, DEC);
+  return printNumber(n, base);
+}
+
+size_t Print::print(unsigned long n, int base) {
+  return printNumber(n, base);
+}
+
+size_t HostSerial::write(uint8_t c) {
+  return fputc(c, stdout) == EOF ? 0 : 1;
+}
+
+//------- IP ADDRESS ------
+
+bool IPAddress::fromString(const char* s) {
+  unsigned a[4];
+  char end;
+  if (sscanf(s, "%u.%u.%u.%u%c", &a[0], &a[1], &a[2], &a[3], &end) != 4)
+    return false;
+  for (uint8_t i = 0; i < 4; i++) {
+    if (a[i] > 255)
+      return false;
+    _addr[i] = a[i];
+  }
+  return true;
+}
+
+//------- SD ------
+
+#include <SD.h>
+
+SDClass SD;
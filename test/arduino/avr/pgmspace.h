@@ -0,0 +1,15 @@
+#ifndef PGMSPACE_H_
+#define PGMSPACE_H_
+
+// Host shim: program memory is ordinary memory, as it is on SAMD
+
+#include <string.h>
+
+#define PROGMEM
+#define pgm_read_byte(addr) (*(const uint8_t*)(addr))
+#define pgm_read_word(addr) (*(const uint16_t*)(addr))
+#define pgm_read_dword(addr) (*(const uint32_t*)(addr))
+#define memcpy_P memcpy
+#define strlen_P strlen
+
+#endif
@@ -0,0 +1,141 @@
+#include <Ethernet2.h>
+#include <EthernetUdp2.h>
+#include <utility/socket.h>
+
+#include "host.h"
+
+EthernetClass Ethernet;
+W5500Class w5500;
+
+HostSocket hostSockets[MAX_SOCK_NUM];
+uint16_t hostTxFree = W5500Class::SSIZE;
+long hostTxWaits;
+uint32_t hostRefused;
+long hostConnects;
+std::deque<HostPacket> hostUdpSent;
+std::deque<HostPacket> hostUdpReceived;
+
+HostSocket* hostFindSocket(IPAddress ip) {
+  for (uint8_t s = 0; s < MAX_SOCK_NUM; s++)
+    if (hostSockets[s].status != SnSR::CLOSED && (uint32_t)hostSockets[s].ip == (uint32_t)ip)
+      return &hostSockets[s];
+  return nullptr;
+}
+
+//------- W5500 ------
+
+uint8_t W5500Class::readSnSR(SOCKET s) {
+  return hostSockets[s].status;
+}
+
+// bytes that test has not taken yet are not acknowledged by server
+uint16_t W5500Class::getTXFreeSize(SOCKET s) {
+  size_t pending = hostSockets[s].tx.size();
+  return pending < hostTxFree ? hostTxFree - pending : 0;
+}
+
+uint8_t socket(SOCKET s, uint8_t protocol, uint16_t port, uint8_t flag) {
+  HostSocket& sock = hostSockets[s];
+  sock.status = SnSR::INIT;
+  sock.tx.clear();
+  sock.rx.clear();
+  return 1;
+}
+
+void close(SOCKET s) {
+  hostSockets[s].status = SnSR::CLOSED;
+}
+
+uint8_t connect(SOCKET s, uint8_t* addr, uint16_t port) {
+  HostSocket& sock = hostSockets[s];
+  hostConnects++;
+  sock.ip = IPAddress(addr[0], addr[1], addr[2], addr[3]);
+  sock.port = port;
+  sock.status = (uint32_t)sock.ip == hostRefused ? SnSR::CLOSED : SnSR::ESTABLISHED;
+  return 1;
+}
+
+//------- CLIENT ------
+
+uint8_t EthernetClient::connected() {
+  if (_sock == MAX_SOCK_NUM)
+    return 0;
+  HostSocket& sock = hostSockets[_sock];
+  return sock.status == SnSR::ESTABLISHED || (sock.status == SnSR::CLOSE_WAIT && !sock.rx.empty());
+}
+
+int EthernetClient::available() {
+  return _sock == MAX_SOCK_NUM ? 0 : hostSockets[_sock].rx.size();
+}
+
+int EthernetClient::read() {
+  int c = peek();
+  if (c >= 0)
+    hostSockets[_sock].rx.erase(0, 1);
+  return c;
+}
+
+int EthernetClient::peek() {
+  if (available() == 0)
+    return -1;
+  return (uint8_t)hostSockets[_sock].rx[0];
+}
+
+size_t EthernetClient::write(const uint8_t* buf, size_t size) {
+  if (!connected())
+    return 0;
+  if (size > w5500.getTXFreeSize(_sock))
+    hostTxWaits++; // W5500 send() would spin until server acknowledges
+  hostSockets[_sock].tx.append((const char*)buf, size);
+  return size;
+}
+
+void EthernetClient::stop() {
+  if (_sock == MAX_SOCK_NUM)
+    return;
+  close(_sock);
+  _sock = MAX_SOCK_NUM;
+}
+
+//------- UDP ------
+
+uint8_t EthernetUDP::begin(uint16_t port) {
+  _open = true;
+  return 1;
+}
+
+void EthernetUDP::stop() {
+  _open = false;
+  _rx.clear();
+  _rxPos = 0;
+}
+
+int EthernetUDP::beginPacket(IPAddress ip, uint16_t port) {
+  _txIp = ip;
+  _txPort = port;
+  _tx.clear();
+  return _open;
+}
+
+size_t EthernetUDP::write(uint8_t c) {
+  _tx += (char)c;
+  return 1;
+}
+
+int EthernetUDP::endPacket() {
+  hostUdpSent.push_back(HostPacket{_txIp, _txPort, _tx});
+  return _open;
+}
+
+int EthernetUDP::parsePacket() {
+  _rx.clear();
+  _rxPos = 0;
+  if (!_open || hostUdpReceived.empty())
+    return 0;
+  HostPacket& packet = hostUdpReceived.front();
+  _rxIp = packet.ip;
+  _rxPort = packet.port;
+  _rx = packet.data;
+  hostUdpReceived.pop_front();
+  return _rx.size();
+}
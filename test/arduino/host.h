@@ -0,0 +1,42 @@
+#ifndef HOST_H_
+#define HOST_H_
+
+#include <deque>
+#include <string>
+
+#include <Arduino.h>
+#include <IPAddress.h>
+#include <utility/w5500.h>
+
+// Host build only: simulated clock and fake W5500 sockets that tests look into
+
+void hostAdvance(unsigned long us); // the clock moves only when told to
+
+// connect() establishes connection at once, server side is played by test
+struct HostSocket {
+  uint8_t status;
+  IPAddress ip;
+  uint16_t port;
+  std::string tx; // written by sketch
+  std::string rx; // to be read by sketch
+};
+
+extern HostSocket hostSockets[MAX_SOCK_NUM];
+extern uint16_t hostTxFree; // TX buffer of every socket
+extern long hostTxWaits; // writes that did not fit into free TX buffer
+extern uint32_t hostRefused; // address that refuses connections
+extern long hostConnects; // connection attempts
+
+HostSocket* hostFindSocket(IPAddress ip); // open socket connected to ip, nullptr if none
+
+// UDP packet, from sketch -- with its destination, to sketch -- with its source
+struct HostPacket {
+  IPAddress ip;
+  uint16_t port;
+  std::string data;
+};
+
+extern std::deque<HostPacket> hostUdpSent;     // sent by sketch
+extern std::deque<HostPacket> hostUdpReceived; // to be received by sketch while its UDP socket is open
+
+#endif
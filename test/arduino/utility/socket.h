@@ -0,0 +1,10 @@
+#ifndef SOCKET_H_
+#define SOCKET_H_
+
+#include <utility/w5500.h>
+
+uint8_t socket(SOCKET s, uint8_t protocol, uint16_t port, uint8_t flag);
+void close(SOCKET s);
+uint8_t connect(SOCKET s, uint8_t* addr, uint16_t port);
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef W5500_H_
+#define W5500_H_
+
+#include <Arduino.h>
+
+#define MAX_SOCK_NUM 8
+
+typedef uint8_t SOCKET;
+
+class SnMR {
+public:
+  static const uint8_t CLOSE = 0x00;
+  static const uint8_t TCP = 0x01;
+  static const uint8_t UDP = 0x02;
+};
+
+class SnSR {
+public:
+  static const uint8_t CLOSED = 0x00;
+  static const uint8_t INIT = 0x13;
+  static const uint8_t SYNSENT = 0x15;
+  static const uint8_t ESTABLISHED = 0x17;
+  static const uint8_t CLOSE_WAIT = 0x1c;
+};
+
+class W5500Class {
+public:
+  static const uint16_t SSIZE = 2048; // TX buffer of each socket
+  uint8_t readSnSR(SOCKET s);
+  uint16_t getTXFreeSize(SOCKET s);
+};
+
+extern W5500Class w5500;
+
+#endif
@@ -0,0 +1,97 @@
+// CRC kernel selected by CRC_KERNEL against the original table code on random frames, and its host throughput.
+// Built once for each kernel, see CMakeLists.txt.
+// Usage: crc_test [<frames>]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../crc.h"
+
+const long DEFAULT_FRAMES = 100000;
+const uint8_t MAX_LEN = 253; // frame with its CRC fits uint8_t length
+const uint8_t BENCH_LEN = 64;
+const long BENCH_FRAMES = 200000;
+
+const char* KERNEL_NAMES[] = { "table", "nibble", "bitwise" };
+
+uint8_t refHi[256];
+uint8_t refLo[256];
+
+// tables of CRC-16/MODBUS as crc.cpp had them before kernels were split
+void setupReference() {
+  for (uint16_t j = 0; j < 256; j++) {
+    uint16_t crc = j;
+    for (uint8_t i = 0; i < 8; i++)
+      crc = (crc & 1) ? (crc >> 1) ^ 0xA001 : crc >> 1;
+    refHi[j] = crc;
+    refLo[j] = crc >> 8;
+  }
+}
+
+// the original computeCRC
+void referenceCRC(byte* a, uint8_t len) {
+  a[len + 0] = 0xff;
+  a[len + 1] = 0xff;
+  for (uint8_t i = 0; i < len; i++) {
+    uint8_t j = a[len + 0] ^ a[i];
+    a[len + 0] = a[len + 1] ^ refHi[j];
+    a[len + 1] = refLo[j];
+  }
+}
+
+int failures;
+
+void check(const char* what, uint8_t len, bool ok) {
+  if (ok)
+    return;
+  if (failures++ < 10)
+    printf("failed: %s, %d bytes\n", what, len);
+}
+
+void checkFrame(byte* a, uint8_t len) {
+  byte ref[MAX_LEN + 2];
+  memcpy(ref, a, len);
+  referenceCRC(ref, len);
+  computeCRC(a, len);
+  check("computeCRC", len, a[len] == ref[len] && a[len + 1] == ref[len + 1]);
+  check("checkCRC of correct frame", len, checkCRC(a, len + 2));
+  check("checkCRC keeps frame", len, memcmp(a, ref, len + 2) == 0);
+  byte crc[2] = { 0xff, 0xff };
+  for (uint8_t i = 0; i < len + 2; i++)
+    updateCRC(crc, a[i]);
+  check("updateCRC residue", len, crc[0] == 0 && crc[1] == 0);
+  uint8_t bit = random() % ((len + 2) * 8);
+  a[bit / 8] ^= 1 << (bit % 8);
+  check("checkCRC of corrupted frame", len, !checkCRC(a, len + 2));
+}
+
+int main(int argc, char** argv) {
+  long frames = argc > 1 ? atol(argv[1]) : DEFAULT_FRAMES;
+  setupReference();
+  byte a[MAX_LEN + 2];
+  memcpy(a, "123456789", 9);
+  computeCRC(a, 9);
+  check("check value 0x4B37", 9, a[9] == 0x37 && a[10] == 0x4B);
+  srandom(1);
+  for (long k = 0; k < frames; k++) {
+    uint8_t len = k < MAX_LEN ? k + 1 : 1 + random() % MAX_LEN;
+    for (uint8_t i = 0; i < len; i++)
+      a[i] = random();
+    checkFrame(a, len);
+  }
+
+  for (uint8_t i = 0; i < BENCH_LEN; i++)
+    a[i] = i * 7 + 3;
+  clock_t start = clock();
+  for (long k = 0; k < BENCH_FRAMES; k++) {
+    a[0] = k;
+    computeCRC(a, BENCH_LEN);
+  }
+  double host = (double)(clock() - start) / CLOCKS_PER_SEC;
+  printf("kernel,bytes/ms\n%s,%.0f\n", KERNEL_NAMES[CRC_KERNEL], BENCH_FRAMES * BENCH_LEN / host / 1000);
+
+  printf("%s\n", failures == 0 ? "ok" : "failed");
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,85 @@
+// DeflatePrint output is inflated by zlib and compared with the input, its size is within the bound of deflate.h.
+// Usage: deflate_test [<inputs> [<seed>]]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include <zlib.h>
+
+#include "../deflate.h"
+
+const long DEFAULT_INPUTS = 3000;
+const size_t MAX_SIZE = 8192;
+
+class VectorPrint : public Print {
+public:
+  std::vector<uint8_t> data;
+  virtual size_t write(uint8_t c) {
+    data.push_back(c);
+    return 1;
+  }
+  using Print::write;
+};
+
+// random bytes, small alphabet with long matches, or CSV lines like uploads
+std::vector<uint8_t> makeInput(long i) {
+  size_t size = i < 3 ? i : rand() % MAX_SIZE;
+  std::vector<uint8_t> in;
+  switch (i % 3) {
+  case 0:
+    while (in.size() < size)
+      in.push_back(rand());
+    break;
+  case 1: {
+    int alphabet = 1 + rand() % 4;
+    while (in.size() < size)
+      in.push_back('a' + rand() % alphabet);
+    break;
+  }
+  default:
+    while (in.size() < size) {
+      char line[40];
+      int n = snprintf(line, sizeof(line), "HE%dw,%d.%d,-%d\n", rand() % 4, rand() % 5000, rand() % 10,
+        rand() % 300000);
+      in.insert(in.end(), line, line + n);
+    }
+    in.resize(size);
+  }
+  return in;
+}
+
+bool roundTrip(const std::vector<uint8_t>& in) {
+  VectorPrint out;
+  DeflatePrint deflate(out);
+  Print& p = deflate;
+  p.write(in.data(), in.size());
+  deflate.finish();
+  if (out.data.size() > in.size() * 9 / 8 + DEFLATE_OVERHEAD) {
+    printf("%zu bytes deflated to %zu\n", in.size(), out.data.size());
+    return false; // requests are sized by this bound
+  }
+  std::vector<uint8_t> res(in.size() + 1);
+  uLongf size = res.size();
+  int rc = uncompress(res.data(), &size, out.data.data(), out.data.size());
+  if (rc != Z_OK) {
+    printf("uncompress failed: %d\n", rc);
+    return false;
+  }
+  res.resize(size);
+  return res == in;
+}
+
+int main(int argc, char** argv) {
+  long inputs = argc > 1 ? atol(argv[1]) : DEFAULT_INPUTS;
+  srand(argc > 2 ? atol(argv[2]) : 1);
+  long failures = 0;
+  for (long i = 0; i < inputs; i++) {
+    std::vector<uint8_t> in = makeInput(i);
+    if (roundTrip(in))
+      continue;
+    failures++;
+    printf("input %ld of %zu bytes does not match\n", i, in.size());
+  }
+  printf("%ld inputs, %ld failed\n", inputs, failures);
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,69 @@
+// Answers are taken only from the configured DNS server and only with the random id of the query in progress.
+
+#include <stdio.h>
+#include <string>
+
+#include "host.h"
+#include "../dns.h"
+
+const IPAddress SERVER(10, 0, 0, 1); // Ethernet.dnsServerIP() of host shim
+const IPAddress RESOLVED(10, 1, 2, 3);
+const uint16_t PORT = 53;
+
+int failures;
+
+void check(const char* what, bool ok) {
+  if (ok)
+    return;
+  failures++;
+  printf("failed: %s\n", what);
+}
+
+uint16_t queryId(const HostPacket& query) {
+  return (uint8_t)query.data[0] << 8 | (uint8_t)query.data[1];
+}
+
+// A record answer to query, with the question copied from it
+HostPacket answer(const HostPacket& query, IPAddress from, uint16_t port, uint16_t id) {
+  std::string a;
+  a += (char)(id >> 8);
+  a += (char)id;
+  a += std::string("\x81\x80\x00\x01\x00\x01\x00\x00\x00\x00", 10);
+  a += query.data.substr(12);
+  a += std::string("\xc0\x0c\x00\x01\x00\x01\x00\x00\x01\x2c\x00\x04", 12);
+  for (int i = 0; i < 4; i++)
+    a += (char)RESOLVED[i];
+  return HostPacket{from, port, a};
+}
+
+// delivers packet and returns what resolveHost says afterwards
+int8_t receive(const char* host, const HostPacket& packet, IPAddress& ip) {
+  hostUdpReceived.push_back(packet);
+  checkDns();
+  return resolveHost(host, ip);
+}
+
+int main() {
+  const char* host = "meter.example.com";
+  IPAddress ip;
+  check("query is sent", resolveHost(host, ip) == DNS_PENDING && hostUdpSent.size() == 1);
+  HostPacket query = hostUdpSent.front();
+  hostUdpSent.clear();
+  check("query goes to DNS server", (uint32_t)query.ip == (uint32_t)SERVER && query.port == PORT);
+  uint16_t id = queryId(query);
+
+  IPAddress other(10, 0, 0, 66);
+  check("answer from other address is ignored", receive(host, answer(query, other, PORT, id), ip) == DNS_PENDING);
+  check("answer from other port is ignored", receive(host, answer(query, SERVER, 5353, id), ip) == DNS_PENDING);
+  check("answer with other id is ignored", receive(host, answer(query, SERVER, PORT, id + 1), ip) == DNS_PENDING);
+  check("answer from server resolves host", receive(host, answer(query, SERVER, PORT, id), ip) == DNS_RESOLVED &&
+    (uint32_t)ip == (uint32_t)RESOLVED);
+
+  resolveHost("other.example.com", ip);
+  check("the next query is sent", hostUdpSent.size() == 1);
+  uint16_t next = hostUdpSent.empty() ? id + 1 : queryId(hostUdpSent.front());
+  check("query ids are not sequential", next != id && next != (uint16_t)(id + 1));
+
+  printf("%s\n", failures == 0 ? "ok" : "failed");
+  return failures == 0 ? 0 : 1;
+}
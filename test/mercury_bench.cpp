@@ -0,0 +1,102 @@
+// Poll rate of the real poll engine against simulated meters with line faults.
+// Usage: mercury_bench [<trace> [<seconds>]] -- trace of captured frames, see traces/mercury230.trace
+
+#include <stdio.h>
+#include <time.h>
+#include <vector>
+
+#include "host.h"
+#include "../Mercury.h"
+#include "../MercurySim.h"
+#include "../crc.h"
+
+const unsigned long LOOP_US = 50; // simulated time of one loop() pass
+const long DEFAULT_SECONDS = 600;
+
+struct Profile {
+  const char* name;
+  MercurySimConfig config;
+};
+
+const Profile PROFILES[] = {
+  { "clean",  { 5,  0,   0,   0, true } },
+  { "jitter", { 10, 40,  0,   0, true } },
+  { "drops",  { 10, 10,  20,  0, true } },
+  { "crc",    { 10, 10,  0, 200, true } },
+};
+
+std::vector<uint8_t> trace;
+
+// '>' request and '<' response lines of hex bytes with address and CRC, '#' comments
+bool loadTrace(const char* path) {
+  FILE* f = fopen(path, "r");
+  if (f == nullptr) {
+    perror(path);
+    return false;
+  }
+  char line[512];
+  std::vector<uint8_t> req;
+  int n = 0;
+  while (fgets(line, sizeof(line), f) != nullptr) {
+    char dir = line[0];
+    if (dir != '>' && dir != '<')
+      continue;
+    std::vector<uint8_t> frame;
+    char* p = line + 1;
+    char* end;
+    for (long b = strtol(p, &end, 16); end != p; b = strtol(p, &end, 16)) {
+      frame.push_back(b);
+      p = end;
+    }
+    if (frame.size() < 4 || frame.size() > 255 || !checkCRC(frame.data(), frame.size())) {
+      fprintf(stderr, "%s: bad frame skipped: %s", path, line);
+      req.clear();
+      continue;
+    }
+    if (dir == '>') {
+      req = frame;
+      continue;
+    }
+    if (req.empty())
+      continue; // response without request
+    trace.push_back(req.size() - 3);
+    trace.insert(trace.end(), req.begin() + 1, req.end() - 2);
+    trace.push_back(frame.size() - 3);
+    trace.insert(trace.end(), frame.begin() + 1, frame.end() - 2);
+    req.clear();
+    n++;
+  }
+  fclose(f);
+  trace.push_back(0);
+  printf("%s: %d frames\n", path, n);
+  return true;
+}
+
+int main(int argc, char** argv) {
+  if (argc > 1) {
+    if (!loadTrace(argv[1]))
+      return 1;
+    mercurySim.setTrace(trace.data());
+  }
+  long seconds = argc > 2 ? atol(argv[2]) : DEFAULT_SECONDS;
+  setupMercury();
+  bool ok = true;
+  printf("profile,passes/s,valid,expected,host us/s\n");
+  for (const Profile& profile : PROFILES) {
+    mercurySim.config = profile.config;
+    long passes = meters[0].passes;
+    clock_t start = clock();
+    for (unsigned long t = 0; t < seconds * 1000000UL; t += LOOP_US) {
+      checkMercury();
+      hostAdvance(LOOP_US);
+    }
+    double host = (double)(clock() - start) / CLOCKS_PER_SEC;
+    double rate = (double)(meters[0].passes - passes) / seconds;
+    printf("%s,%.2f,%d,%d,%.1f\n", profile.name, rate, meters[0].validValues, meters[0].expectedValues,
+      host * 1e6 / seconds);
+    if (rate <= 0 || meters[0].validValues <= 0)
+      ok = false;
+  }
+  printMercuryStats(SerialUSB);
+  return ok ? 0 : 1;
+}
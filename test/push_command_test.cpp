@@ -0,0 +1,72 @@
+// Inbound messages in response body are run as commands only when the server answered 200 OK,
+// and the index of a message is acknowledged only after it was run.
+
+#include <stdio.h>
+#include <string>
+
+#include "host.h"
+#include "../push.h"
+
+const char HOST[] = "10.0.0.3";
+const unsigned long STEP_US = 10000; // simulated time of one loop() pass
+const unsigned long MAX_WAIT_US = 3600000000UL;
+
+PushDest haworks_data(0x01, "10.0.0.1", 80, "/data.csv", "Authenticate: basic test"); // not checked
+PushMsgDest haworks_message(0x02, (char*)HOST, 80, "/message.csv", "Authenticate: basic test");
+
+int failures;
+int runs;
+
+void check(const char* what, bool ok) {
+  if (ok)
+    return;
+  failures++;
+  printf("failed: %s\n", what);
+}
+
+void ping(char* args) {
+  runs++;
+}
+
+// steps till the next request is complete and answers it, returns request
+std::string answer(const char* status, const char* body) {
+  IPAddress ip;
+  ip.fromString(HOST);
+  std::string request;
+  for (unsigned long t = 0; t < MAX_WAIT_US && request.empty(); t += STEP_US) {
+    haworks_message.check();
+    HostSocket* sock = hostFindSocket(ip);
+    size_t end = sock == nullptr ? std::string::npos : sock->tx.find("\r\n\r\n");
+    size_t cl = sock == nullptr ? std::string::npos : sock->tx.find("Content-Length: ");
+    if (end != std::string::npos && cl < end && sock->tx.size() >= end + 4 + atol(sock->tx.c_str() + cl + 16)) {
+      request = sock->tx;
+      sock->tx.clear();
+      char response[200];
+      snprintf(response, sizeof(response), "HTTP/1.1 %s\r\nContent-Length: %d\r\n\r\n%s", status, (int)strlen(body), body);
+      sock->rx = response;
+    }
+    hostAdvance(STEP_US);
+  }
+  for (int i = 0; i < 100; i++) {
+    haworks_message.check();
+    hostAdvance(STEP_US);
+  }
+  return request;
+}
+
+int main() {
+  setupPush();
+  pushCommandRoute("ping", &ping);
+  answer("200 OK", ""); // new session
+  std::string request = answer("500 Internal Server Error", "4,ping,x,7\n");
+  check("request is sent", !request.empty());
+  check("command is not run after error status", runs == 0);
+  request = answer("200 OK", "4,ping,x,7\n");
+  check("index of message that was not run is not acknowledged", request.find("index=7") == std::string::npos);
+  check("command is run after OK status", runs == 1);
+  request = answer("200 OK", "4,ping,x,7\n");
+  check("index is acknowledged", request.find("index=7") != std::string::npos);
+  check("command is run once", runs == 1);
+  printf("%s\n", failures == 0 ? "ok" : "failed");
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,113 @@
+#!/usr/bin/env python3
+"""Binary uploads decode to the same records as CSV uploads of the same values.
+
+Runs push_test, which uploads the same changes to a CSV and a binary destination, decodes
+binary bodies with tools/push_decode.py and compares everything the server accepted from
+each destination. Requests after a failed one must start a new session (FULL flag), the
+others must send deltas against the session. Values of failed requests are queued and sent
+with their report times; when only binary request failed, CSV has them without time.
+
+Usage: push_decode_test.py <push_test> <dir>
+"""
+
+import collections
+import os
+import subprocess
+import sys
+import zlib
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "tools"))
+import push_decode  # noqa: E402
+
+
+# samples of jump() in push_test that are beyond int16 quanta from the previous ones
+WIDE_SAMPLES = [("Ew", 50009.0), ("Ew", 1000.0), ("Ew", -40000.0), ("Ew", 70000.0)]
+
+
+def csv_records(body, start):
+    records = []
+    for line in body.decode("ascii").splitlines():
+        fields = line.split(",")
+        tag = fields[0][1:]
+        value = float(fields[1])
+        time = None
+        if len(fields) > 2:
+            time = fields[2] if "T" in fields[2] else start + int(fields[2])  # history or sample
+        records.append((tag, value, time))
+    return records
+
+
+def binary_records(records, start):
+    return [(tag, float(value), time if time is None or isinstance(time, str) else start + time)
+            for tag, value, time in records]
+
+
+def key(record):
+    tag, value, time = record
+    return (tag, str(time), round(value, 6))
+
+
+def unmatched(csv, binary):
+    """Records of each side that are not in the other one."""
+    left = collections.Counter(map(key, csv))
+    extra = []
+    for tag, value, time in binary:
+        for k in (key((tag, value, time)), key((tag, value, None))):  # queued by binary destination only
+            if left[k] > 0:
+                left[k] -= 1
+                break
+        else:
+            extra.append((tag, value, time))
+    return sorted(left.elements()), extra
+
+
+def main():
+    program, out = sys.argv[1:3]
+    os.makedirs(out, exist_ok=True)
+    subprocess.run([program, out], check=True, stdout=subprocess.DEVNULL)
+    session = push_decode.Session()
+    csv = []
+    binary = []
+    errors = []
+    full = 0
+    deltas = 0
+    failed = True  # new session at start
+    with open(os.path.join(out, "requests.txt")) as f:
+        requests = [line.split() for line in f]
+    for name, start, status in requests:
+        with open(os.path.join(out, name), "rb") as f:
+            body = f.read()
+        ok = status == "200"
+        if body[:1] == bytes([push_decode.ZLIB_HEADER]):
+            body = zlib.decompress(body)
+        if name.endswith(".csv"):
+            if ok:
+                csv += csv_records(body, int(start))
+            continue
+        is_full = body[0] & push_decode.FULL != 0
+        if is_full != failed:
+            errors.append("%s: %s after %s request" % (name, "new session" if is_full else "deltas",
+                                                      "failed" if failed else "successful"))
+        records, commit = session.decode(body)
+        if ok:
+            commit()
+            binary += binary_records(records, int(start))
+            full += is_full
+            deltas += not is_full
+        failed = not ok
+    if full < 2 or deltas < 2:
+        errors.append("%d new sessions & %d delta requests were accepted" % (full, deltas))
+    for tag, value in WIDE_SAMPLES:
+        if not all(any(r[:2] == (tag, value) for r in records) for records in (csv, binary)):
+            errors.append("H%s,%s sample is missing" % (tag, value))
+    csv_only, binary_only = unmatched(csv, binary)
+    if csv_only or binary_only:
+        errors.append("records differ:\n  csv    %s\n  binary %s" % (csv_only, binary_only))
+    for error in errors:
+        print(error)
+    print("%d requests, %d records: %s" % (len(requests), len(csv), "failed" if errors else "ok"))
+    return 1 if errors else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,88 @@
+// Values that fail to upload because connection is refused are queued and sent with their report times
+// once server is back.
+
+#include <stdio.h>
+#include <string>
+
+#include "host.h"
+#include "../push.h"
+#include "../queue.h"
+#include "../tags.h"
+
+const char HOST[] = "10.0.0.9";
+const unsigned long STEP_US = 10000; // simulated time of one loop() pass
+const int FAILED_CONNECTS = 13;
+
+QueueRecord slots[16];
+RamQueueStore store(slots, 16);
+PushQueue queue(store, EVICT_PRIORITY);
+
+PushDest haworks_data(0x01, (char*)HOST, 80, "/data.csv", "Authenticate: basic test", PUSH_CSV, &queue);
+PushMsgDest haworks_message(0x02, "10.0.0.3", 80, "/message.csv", "Authenticate: basic test"); // not checked
+
+const PushId ID = meterTag(0, T_HERTZ);
+
+int failures;
+
+void check(const char* what, bool ok) {
+  if (ok)
+    return;
+  failures++;
+  printf("failed: %s\n", what);
+}
+
+// steps until n more connections are refused and the last failure is handled
+void failConnects(int n) {
+  long connects = hostConnects + n;
+  while (hostConnects < connects) {
+    haworks_data.check();
+    hostAdvance(STEP_US);
+  }
+  haworks_data.check();
+}
+
+int main() {
+  IPAddress ip;
+  ip.fromString(HOST);
+  hostRefused = ip;
+  setupPush();
+  pushItems[ID].deadband = 0;
+  push(ID, 500, 1);
+  unsigned long reported = millis();
+  failConnects(1);
+  check("value is queued when connection fails", queue.count() == 1);
+  QueueRecord rec;
+  queue.peek(0, rec);
+  check("queued value", rec.id == ID && rec.val == 500 && rec.time == reported);
+  check("queued value is not sent again as update", (pushItems[ID].updated & 0x01) == 0);
+
+  push(ID, 499, 1);
+  failConnects(FAILED_CONNECTS - 1);
+  check("change during outage is queued", queue.count() == 2);
+  queue.peek(1, rec);
+  check("queued change", rec.id == ID && rec.val == 499);
+
+  // server is back: queued values are sent
+  hostRefused = 0;
+  std::string body;
+  for (unsigned long t = 0; t < 3600000000UL && body.empty(); t += STEP_US) {
+    haworks_data.check();
+    HostSocket* sock = hostFindSocket(ip);
+    size_t end = sock == nullptr ? std::string::npos : sock->tx.find("\r\n\r\n");
+    if (end != std::string::npos) {
+      body = sock->tx.substr(end + 4);
+      sock->tx.clear();
+      sock->rx = "HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n";
+    }
+    hostAdvance(STEP_US);
+  }
+  for (int i = 0; i < 100; i++) {
+    haworks_data.check();
+    hostAdvance(STEP_US);
+  }
+  check("queued values are sent", body.find("HEf,50.0,") == 0 && body.find("\nHEf,49.9,") != std::string::npos);
+  check("queue is empty after upload", queue.count() == 0);
+  printf("%s", body.c_str());
+  printf("%s\n", failures == 0 ? "ok" : "failed");
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,220 @@
+// Uploads the same values to CSV (deflated) and binary data destinations through fake sockets and saves request
+// bodies, push_decode_test.py decodes binary bodies with tools/push_decode.py and compares them with CSV ones.
+// Requests must fit into free TX buffer of socket, so that they are written without waiting.
+// Usage: push_test <dir> -- bodies are saved as <dir>/<n>.csv|bin, <dir>/requests.txt lists them:
+//   <file> <millis when request was sent> <response status>
+
+#include <stdio.h>
+#include <string>
+
+#include "host.h"
+#include "../push.h"
+#include "../queue.h"
+#include "../tags.h"
+
+const char CSV_HOST[] = "10.0.0.1";
+const char BINARY_HOST[] = "10.0.0.2";
+const unsigned long STEP_US = 10000; // simulated time of one loop() pass
+const unsigned long QUIET_MS = NEXT_INTERVAL + 60000L; // destinations have nothing more to upload
+const uint16_t SMALL_TX = 250; // free TX buffer that requests are split to fit
+const unsigned long SAMPLE_MS = 1000;
+const uint8_t SAMPLE_CAPACITY = 32;
+
+// values of failed requests are queued and sent with their report times
+QueueRecord csv_slots[64];
+RamQueueStore csv_store(csv_slots, 64);
+PushQueue csv_queue(csv_store);
+QueueRecord binary_slots[64];
+RamQueueStore binary_store(binary_slots, 64);
+PushQueue binary_queue(binary_store);
+
+PushDest haworks_data(0x01, (char*)CSV_HOST, 80, "/data.csv", "Authenticate: basic test", PUSH_CSV | PUSH_DEFLATE,
+  &csv_queue);
+PushMsgDest haworks_message(0x02, "10.0.0.3", 80, "/message.csv", "Authenticate: basic test"); // not checked
+PushDest binary_data(0x04, (char*)BINARY_HOST, 80, "/data.bin", "Authenticate: basic test", PUSH_BINARY,
+  &binary_queue);
+const char SECOND_BINARY_HOST[] = "10.0.0.4";
+PushDest second_binary(0x08, (char*)SECOND_BINARY_HOST, 80, "/data.bin", "Authenticate: basic test", PUSH_BINARY); // disabled
+
+PushSeries series;
+int16_t deltas[SAMPLE_CAPACITY];
+
+// server side of one destination
+struct Server {
+  const char* host;
+  const char* ext;
+  bool fail;        // the next request is answered with 500
+  int requests;     // answered requests
+  unsigned long start; // when the first byte of current request arrived
+};
+
+Server servers[] = {
+  { CSV_HOST, "csv" },
+  { BINARY_HOST, "bin" },
+};
+
+const char* dir;
+FILE* index_file;
+int bodies;
+
+// answers complete request, body ends after Content-Length bytes
+void serve(Server& server) {
+  IPAddress ip;
+  ip.fromString(server.host);
+  HostSocket* sock = hostFindSocket(ip);
+  if (sock == nullptr || sock->tx.empty())
+    return;
+  if (server.start == 0)
+    server.start = millis();
+  size_t end = sock->tx.find("\r\n\r\n");
+  if (end == std::string::npos)
+    return;
+  size_t cl = sock->tx.find("Content-Length: ");
+  if (cl == std::string::npos || cl > end)
+    return;
+  size_t size = atol(sock->tx.c_str() + cl + 16);
+  if (sock->tx.size() < end + 4 + size)
+    return;
+  char name[32];
+  snprintf(name, sizeof(name), "%d.%s", ++bodies, server.ext);
+  std::string path = std::string(dir) + "/" + name;
+  FILE* f = fopen(path.c_str(), "wb");
+  fwrite(sock->tx.data() + end + 4, 1, size, f);
+  fclose(f);
+  int status = server.fail ? 500 : 200;
+  fprintf(index_file, "%s %lu %d\n", name, server.start, status);
+  sock->tx.erase(0, end + 4 + size);
+  sock->rx = server.fail ? "HTTP/1.1 500 Internal Server Error\r\nContent-Length: 0\r\n\r\n" :
+    "HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n";
+  server.start = 0;
+  server.fail = false;
+  server.requests++;
+}
+
+void step() {
+  PushDest::checkIdle();
+  haworks_data.check();
+  binary_data.check();
+  second_binary.check();
+  for (Server& server : servers)
+    serve(server);
+  hostAdvance(STEP_US);
+}
+
+// destinations upload changes till there is nothing left, returns requests of each destination
+void upload(int* requests) {
+  int csv = servers[0].requests;
+  int binary = servers[1].requests;
+  setPushInterval(pushInterval); // due in pushInterval unless retrying after failure
+  for (unsigned long quiet = millis(); millis() - quiet < QUIET_MS; ) {
+    int n = servers[0].requests + servers[1].requests;
+    step();
+    if (servers[0].requests + servers[1].requests != n)
+      quiet = millis();
+  }
+  requests[0] = servers[0].requests - csv;
+  requests[1] = servers[1].requests - binary;
+}
+
+// checks requests of a round
+bool expect(const char* round, int csv, int binary, bool split = false) {
+  int requests[2];
+  upload(requests);
+  bool ok = split ? requests[0] >= csv && requests[1] >= binary : requests[0] == csv && requests[1] == binary;
+  if (!ok)
+    printf("%s: %d CSV & %d binary requests, expected %s%d & %d\n", round, requests[0], requests[1],
+      split ? "at least " : "", csv, binary);
+  return ok;
+}
+
+// values of phase 1 and total, n samples of total power, one of them is a gap
+void change(int round, int samples) {
+  PushTime time = { 26, 10, (uint8_t)(1 + round), 0, 30 };
+  push(meterTag(0, T_WATTS_0), 1000 + round * 37, 1);
+  push(meterTag(0, T_HERTZ), 500 - round, 1);
+  if (round % 2 == 0)
+    push(phaseTag(0, 1, T_VOLTS_1), 2300 + round * 11, 1);
+  push(phaseTag(0, 1, T_AMPS_1), -round * 3, 2); // converted to precision of tag
+  pushHistory(meterTag(0, T_PREV_DAY_0), 123456 + round, 3, time);
+  PushId id = meterTag(0, T_WATTS_SAMPLES_0);
+  for (int i = 0; i < samples; i++) {
+    pushSample(id, 10000 + round * 500 + i * 130 - (i % 2) * 260, 1, i != 2);
+    hostAdvance(SAMPLE_MS * 1000);
+  }
+  pushSample(id, 0, 1, false); // closes the last interval
+}
+
+// samples that jump by more than int16 quanta, up and down
+void jump(int round) {
+  PushId id = meterTag(0, T_WATTS_SAMPLES_0);
+  const int32_t values[] = { 500000 + round * 10, 10000, -400000, -400000 + round * 10, 700000 };
+  for (int32_t val : values) {
+    pushSample(id, val, 1, true);
+    hostAdvance(SAMPLE_MS * 1000);
+  }
+  pushSample(id, 0, 1, false);
+}
+
+// all tags that are not series change
+void changeAll(int round) {
+  for (PushId id = 0; id < PUSH_TAG_COUNT; id++)
+    if (pushItems[id].series == nullptr)
+      push(id, round * 1000 + id, 1);
+}
+
+int main(int argc, char** argv) {
+  if (argc < 2) {
+    printf("usage: push_test <dir>\n");
+    return 2;
+  }
+  dir = argv[1];
+  std::string path = std::string(dir) + "/requests.txt";
+  index_file = fopen(path.c_str(), "w");
+  if (index_file == nullptr) {
+    perror(path.c_str());
+    return 1;
+  }
+  setupPush();
+  for (PushId id = 0; id < PUSH_TAG_COUNT; id++)
+    pushItems[id].deadband = 0;
+  pushSeries(meterTag(0, T_WATTS_SAMPLES_0), series, deltas, 10, SAMPLE_MS, SAMPLE_CAPACITY);
+  bool ok = true;
+  change(1, 5);
+  ok &= expect("new session", 1, 1);
+  change(2, 4);
+  ok &= expect("deltas", 1, 1);
+  change(3, 6);
+  servers[0].fail = servers[1].fail = true;
+  ok &= expect("failure", 2, 2); // the same values again, new binary session
+  change(4, 5);
+  servers[1].fail = true;
+  ok &= expect("binary failure", 1, 2); // CSV has samples that binary destination has not
+  change(5, 3);
+  ok &= expect("deltas after failure", 1, 1);
+  hostTxFree = SMALL_TX;
+  change(6, 30);
+  changeAll(6);
+  ok &= expect("split", 2, 2, true);
+  hostTxFree = W5500Class::SSIZE;
+  change(7, 2);
+  ok &= expect("after split", 1, 1);
+  jump(8);
+  ok &= expect("wide deltas", 1, 1);
+  jump(9);
+  change(9, 3);
+  servers[0].fail = servers[1].fail = true;
+  ok &= expect("wide deltas after failure", 2, 2);
+  if (hostTxWaits > 0) {
+    printf("%ld writes did not fit into TX buffer\n", hostTxWaits);
+    ok = false;
+  }
+  IPAddress second;
+  second.fromString(SECOND_BINARY_HOST);
+  if (hostFindSocket(second) != nullptr) {
+    printf("the second binary destination was not disabled\n");
+    ok = false;
+  }
+  fclose(index_file);
+  printf("%d requests\n", bodies);
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,149 @@
+// Queue of values that failed to upload: eviction order and bookkeeping of the request being sent,
+// over RAM slots and over file slots like on SD card, file slots are restored when queue begins again.
+// Usage: queue_test [<file>] -- file for file slots
+
+#include <stdio.h>
+
+#include "host.h"
+#include "../queue.h"
+#include "../tags.h"
+
+const PushId FAST = meterTag(0, T_HERTZ);
+const PushId SLOW = meterTag(0, T_CUR_DAY_0);
+
+int failures;
+
+// queued values from the oldest one must be as expected
+void expect(const char* name, PushQueue& queue, const int32_t* vals, uint16_t n) {
+  bool ok = queue.count() == n;
+  QueueRecord rec;
+  for (uint16_t i = 0; ok && i < n; i++) {
+    queue.peek(i, rec);
+    ok = rec.val == vals[i] && rec.time == (unsigned long)vals[i] * 1000;
+  }
+  if (ok)
+    return;
+  failures++;
+  printf("%s: expected", name);
+  for (uint16_t i = 0; i < n; i++)
+    printf(" %d", vals[i]);
+  printf(", got");
+  for (uint16_t i = 0; i < queue.count(); i++) {
+    queue.peek(i, rec);
+    printf(" %d", rec.val);
+  }
+  printf("\n");
+}
+
+void add(PushQueue& queue, PushId id, int32_t val) {
+  queue.add(QueueRecord{id, val, (unsigned long)val * 1000});
+}
+
+// capacity of store is 4
+void testPriority(const char* name, QueueStore& store) {
+  PushQueue queue(store, EVICT_PRIORITY);
+  queue.begin();
+  add(queue, SLOW, 0);
+  add(queue, FAST, 1);
+  add(queue, SLOW, 2);
+  add(queue, FAST, 3);
+  add(queue, SLOW, 4); // the oldest fast value is dropped
+  const int32_t evicted[] = { 0, 2, 3, 4 };
+  expect(name, queue, evicted, 4);
+  add(queue, FAST, 5);
+  const int32_t evicted2[] = { 0, 2, 4, 5 };
+  expect(name, queue, evicted2, 4);
+
+  queue.startSend(3); // 0 2 4
+  add(queue, SLOW, 6); // fast 5 after the request is dropped
+  add(queue, SLOW, 7); // no fast values -- the oldest one in the request is dropped
+  const int32_t sending[] = { 2, 4, 6, 7 };
+  expect(name, queue, sending, 4);
+  queue.doneSend(true); // 2 4 were sent
+  const int32_t sent[] = { 6, 7 };
+  expect(name, queue, sent, 2);
+
+  queue.startSend(2);
+  queue.doneSend(false); // failed request keeps values
+  expect(name, queue, sent, 2);
+  add(queue, FAST, 8);
+  queue.startSend(3);
+  queue.doneSend(true);
+  expect(name, queue, nullptr, 0);
+}
+
+void testOldest(const char* name, QueueStore& store) {
+  PushQueue queue(store, EVICT_OLDEST);
+  queue.begin();
+  for (int32_t v = 0; v < 7; v++)
+    add(queue, SLOW, v);
+  const int32_t kept[] = { 3, 4, 5, 6 };
+  expect(name, queue, kept, 4);
+}
+
+// queue over a reopened file is restored with the same records, the restart lost the time since last change
+void testReopen(const char* path) {
+  {
+    PosixQueueStore file(path, 4);
+    PushQueue queue(file, EVICT_OLDEST);
+    queue.begin();
+    for (int32_t v = 0; v < 6; v++)
+      add(queue, SLOW, v);
+    queue.startSend(1);
+    queue.doneSend(true);
+  }
+  unsigned long saved = millis();
+  hostAdvance(5000000);
+  PosixQueueStore file(path, 4);
+  PushQueue queue(file, EVICT_OLDEST);
+  queue.begin();
+  const int32_t kept[] = { 3, 4, 5 };
+  bool ok = queue.count() == 3;
+  QueueRecord rec;
+  for (uint16_t i = 0; ok && i < 3; i++) {
+    queue.peek(i, rec);
+    ok = rec.val == kept[i] && millis() - rec.time == saved - kept[i] * 1000;
+  }
+  if (!ok) {
+    failures++;
+    printf("file reopened: %d records\n", queue.count());
+  }
+  add(queue, SLOW, 6);
+  queue.peek(3, rec);
+  if (rec.time != 6000) {
+    failures++;
+    printf("file reopened: time of new record %lu\n", rec.time);
+  }
+
+  QueueRecord slots[4];
+  RamQueueStore ram(slots, 4);
+  PushQueue empty(ram);
+  empty.begin();
+  add(empty, SLOW, 0);
+  empty.begin();
+  if (empty.count() != 0) {
+    failures++;
+    printf("ram: %d records after begin\n", empty.count());
+  }
+}
+
+int main(int argc, char** argv) {
+  pushItems[FAST].rate = PUSH_FAST;
+  pushItems[SLOW].rate = PUSH_SLOW;
+
+  QueueRecord slots[4];
+  RamQueueStore ram(slots, 4);
+  testPriority("ram priority", ram);
+  testOldest("ram oldest", ram);
+
+  const char* path = argc > 1 ? argv[1] : "queue_test.bin";
+  remove(path); // left by previous run
+  PosixQueueStore file(path, 4);
+  testPriority("file priority", file);
+  testOldest("file oldest", file);
+  remove(path);
+  testReopen(path);
+
+  printf("%s\n", failures == 0 ? "ok" : "failed");
+  return failures == 0 ? 0 : 1;
+}
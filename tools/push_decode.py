@@ -0,0 +1,144 @@
+#!/usr/bin/env python3
+"""Reference decoder of binary push format (PUSH_BINARY in push.h).
+
+Server keeps a Session per controller. Decoded state is committed only when the
+request is answered with 200 OK; the controller starts a new session with full
+dictionary and values after any failed request.
+
+Bodies that were sent with Content-Encoding: deflate (PUSH_DEFLATE) are inflated first,
+zlib is the reference decompressor of deflate.cpp. Inflated CSV bodies are printed as is.
+
+Usage: push_decode.py body.bin [body.bin ...]  -- decodes requests of one session in order
+"""
+
+import sys
+import zlib
+
+VERSION = 2  # 1 -- without queued section
+FULL = 0x80
+ZLIB_HEADER = 0x78
+
+
+class Reader:
+    def __init__(self, data):
+        self.data = data
+        self.pos = 0
+
+    def byte(self):
+        b = self.data[self.pos]
+        self.pos += 1
+        return b
+
+    def bytes(self, n):
+        b = self.data[self.pos:self.pos + n]
+        if len(b) != n:
+            raise ValueError("truncated body")
+        self.pos += n
+        return b
+
+    def varint(self):
+        v = 0
+        shift = 0
+        while True:
+            b = self.byte()
+            v |= (b & 0x7f) << shift
+            if b < 0x80:
+                return v
+            shift += 7
+
+    def zigzag(self):
+        v = self.varint()
+        return (v >> 1) ^ -(v & 1)
+
+
+def fixnum(mantissa, prec):
+    return mantissa / 10 ** prec if prec else mantissa
+
+
+class Session:
+    def __init__(self):
+        self.tags = {}   # id -> tag
+        self.acked = {}  # id -> mantissa
+
+    def decode(self, body):
+        """Returns (records, commit), commit() makes decoded values base for next request."""
+        r = Reader(body)
+        header = r.byte()
+        version = header & 0x7f
+        if version < 1 or version > VERSION:
+            raise ValueError("unsupported version %d" % version)
+        full = header & FULL != 0
+        tags = {} if full else dict(self.tags)
+        acked = {} if full else dict(self.acked)
+        records = []
+        for _ in range(r.varint()):
+            id = r.varint()
+            tags[id] = r.bytes(r.byte()).decode("ascii")
+            acked.pop(id, None)
+
+        def key():
+            k = r.varint()
+            id = k >> 3
+            if id not in tags:
+                raise KeyError("unknown tag id %d" % id)  # answer with error to start new session
+            return id, k & 7
+
+        for _ in range(r.varint() if version >= 2 else 0):
+            id, prec = key()
+            v = r.zigzag()
+            records.append((tags[id], fixnum(v, prec), r.zigzag()))  # queued while upload failed
+        for _ in range(r.varint()):
+            id, prec = key()
+            v = acked.get(id, 0) + r.zigzag()
+            acked[id] = v
+            records.append((tags[id], fixnum(v, prec), None))
+        for _ in range(r.varint()):
+            id, prec = key()
+            v = r.zigzag()
+            yy, mm, dd, hh, mi = r.bytes(5)
+            time = "20%02d-%02d-%02dT%02d:%02d" % (yy, mm, dd, hh, mi)
+            records.append((tags[id], fixnum(v, prec), time))
+        for _ in range(r.varint()):
+            id, prec = key()
+            interval = r.varint()
+            quantum = r.varint()
+            end = r.zigzag()
+            n = r.varint()
+            q = 0
+            for k in range(n):
+                s = r.varint()
+                if s == 0:
+                    continue  # gap
+                s >>= 1
+                q += (s >> 1) ^ -(s & 1)
+                records.append((tags[id], fixnum(q * quantum, prec), end - (n - 1 - k) * interval))
+        if r.pos != len(body):
+            raise ValueError("%d extra bytes" % (len(body) - r.pos))
+
+        def commit():
+            self.tags = tags
+            self.acked = acked
+        return records, commit
+
+
+def main():
+    session = Session()
+    for name in sys.argv[1:]:
+        with open(name, "rb") as f:
+            body = f.read()
+        if body[:1] == bytes([ZLIB_HEADER]):
+            raw = zlib.decompress(body)
+            print("# %s: %d bytes deflated from %d" % (name, len(body), len(raw)))
+            body = raw
+        if body[:1] == b"H":
+            sys.stdout.write(body.decode("ascii"))  # CSV body
+            continue
+        records, commit = session.decode(body)
+        commit()
+        print("# %s: %d bytes, %d records" % (name, len(body), len(records)))
+        for tag, value, time in records:
+            print("H%s,%s%s" % (tag, value, "" if time is None else ",%s" % time))
+
+
+if __name__ == "__main__":
+    main()